@@ -0,0 +1,123 @@
+/// @file
+/// @brief Helpers shared by the micro-benchmarks: synthetic calendars and timing.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "files.hpp"  // Also defines get_config_directory() for logging.cpp.
+
+#include "fmt/format.h"
+
+namespace usos_rpc::benchmarks {
+
+    /// @brief Generates a calendar shaped like a USOS timetable export: repeated subjects and buildings,
+    /// unique identifiers and URLs, folded lines and escaped characters.
+    /// @param events number of events
+    /// @return iCalendar text
+    [[nodiscard]]
+    std::string synthetic_calendar(std::size_t events) {
+        constexpr std::array<std::string_view, 5> SUBJECTS {
+            "Analiza matematyczna",
+            "Algebra liniowa z geometrią analityczną",
+            "Programowanie obiektowe",
+            "Systemy operacyjne",
+            "Bazy danych",
+        };
+        constexpr std::array<std::string_view, 4> TYPES { "WYK", "CW", "LAB", "SEM" };
+
+        std::string text(
+            "BEGIN:VCALENDAR\r\n"
+            "VERSION:2.0\r\n"
+            "PRODID:-//USOS//USOS Calendar 1.0//PL\r\n"
+            "X-WR-CALNAME:Plan zajęć - Jan Kowalski\r\n"
+            "X-WR-TIMEZONE:Europe/Warsaw\r\n"
+            "CALSCALE:GREGORIAN\r\n"
+        );
+        auto append_folded = [&text](std::string_view line) {
+            // Lines are folded at 75 octets, without splitting UTF-8 sequences.
+            while (line.size() > 75) {
+                std::size_t cut = 75;
+                while ((static_cast<unsigned char>(line[cut]) & 0xC0) == 0x80) {
+                    cut--;
+                }
+                text.append(line.substr(0, cut));
+                text.append("\r\n ");
+                line.remove_prefix(cut);
+            }
+            text.append(line);
+            text.append("\r\n");
+        };
+        for (std::size_t i = 0; i < events; i++) {
+            auto day = 1 + (i / 6) % 28;
+            auto month = 1 + (i / 168) % 12;
+            auto hour = 8 + (i % 6) * 2;
+            auto subject = SUBJECTS[(i * 7 + 3) % SUBJECTS.size()];
+            auto type = TYPES[(i * 5 + 1) % TYPES.size()];
+
+            text.append("BEGIN:VEVENT\r\n");
+            text.append(fmt::format("DTSTAMP;VALUE=DATE-TIME:20240301T1200{:02}Z\r\n", i % 60));
+            text.append(fmt::format("DTSTART;VALUE=DATE-TIME:2024{:02}{:02}T{:02}1500\r\n", month, day, hour));
+            text.append(fmt::format("DTEND;VALUE=DATE-TIME:2024{:02}{:02}T{:02}0000\r\n", month, day, hour + 2));
+            auto summary = i % 7 != 0 ? fmt::format("{} - {}", type, subject) : std::string(subject);
+            append_folded(fmt::format("SUMMARY:{}", summary));
+            text.append(fmt::format("UID:{}-event@usos.example.edu.pl\r\n", i));
+            if (i % 5 == 0) {
+                append_folded("DESCRIPTION:zajęcia zdalne");
+            } else {
+                append_folded(fmt::format(
+                    "DESCRIPTION:sala: {}.{:02}\\nBudynek Wydziału Nr {}\\n"
+                    "https://usosweb.example.edu.pl/kontroler.php?_action=katalog2/przedmioty&id={}\\n",
+                    i % 4,
+                    i % 50,
+                    i % 3,
+                    i
+                ));
+                text.append(fmt::format("LOCATION:ul. Banacha {}\\, 02-097 Warszawa\r\n", i % 3));
+            }
+            text.append("END:VEVENT\r\n");
+        }
+        text.append("END:VCALENDAR\r\n");
+        return text;
+    }
+
+    /// @brief Runs a function several times and measures the fastest run, which is the least disturbed one.
+    /// @param function function to measure
+    /// @param runs number of runs
+    /// @return duration of the fastest run
+    template <typename Function>
+    [[nodiscard]]
+    std::chrono::duration<double> fastest_run(Function&& function, int runs = 5) {
+        auto fastest = std::chrono::duration<double>::max();
+        for (int run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            fastest = std::min<std::chrono::duration<double>>(fastest, std::chrono::steady_clock::now() - start);
+        }
+        return fastest;
+    }
+
+    /// @brief Computes throughput in megabytes per second.
+    /// @param bytes number of processed bytes
+    /// @param duration processing time
+    /// @return throughput
+    [[nodiscard]]
+    double megabytes_per_second(std::size_t bytes, std::chrono::duration<double> duration) {
+        return static_cast<double>(bytes) / 1e6 / duration.count();
+    }
+
+    /// @brief Computes time per item in nanoseconds.
+    /// @param items number of processed items
+    /// @param duration processing time
+    /// @return time per item
+    [[nodiscard]]
+    double nanoseconds_per_item(std::size_t items, std::chrono::duration<double> duration) {
+        return duration.count() * 1e9 / static_cast<double>(items);
+    }
+
+}
@@ -0,0 +1,104 @@
+/// @file
+/// @brief Reports the memory used by the events of a 10k-event calendar: fixed-size records with dictionary-encoded
+/// text, against the layout of the old Event class, which kept its own copies of all strings.
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "icalendar/event_record.hpp"
+#include "icalendar/parser.hpp"
+
+#include "date/date.h"
+#include "fmt/format.h"
+
+namespace {
+
+    /// @brief Layout of the old Event class.
+    struct LegacyEvent {
+        struct FullLocation {
+            std::string room;
+            std::string building;
+            std::string address;
+        };
+
+        std::string uid;
+        std::string subject;
+        std::optional<std::string> type;
+        std::optional<std::string> url;
+        std::variant<std::monostate, std::string, FullLocation> location;
+        date::local_seconds start;
+        date::local_seconds end;
+    };
+
+    /// @brief Returns the number of bytes a string keeps on the heap, 0 if it fits in the string object.
+    /// @param text string to check
+    /// @return heap size
+    std::size_t heap_size(const std::string& text) {
+        const auto* object = reinterpret_cast<const char*>(&text);
+        const bool small = text.data() >= object && text.data() < object + sizeof(std::string);
+        return small ? 0 : text.capacity() + 1;
+    }
+
+}
+
+int main() {
+    using namespace usos_rpc;
+    constexpr std::size_t EVENTS = 10'000;
+
+    const auto text = benchmarks::synthetic_calendar(EVENTS);
+    const auto calendar = icalendar::parse(text);
+    fmt::print("Synthetic calendar: {} events, {} bytes\n", calendar.records().size(), text.size());
+
+    // Strings are copied into events exactly like the old parser did.
+    std::vector<LegacyEvent> legacy;
+    legacy.reserve(calendar.records().size());
+    std::size_t legacy_heap = 0;
+    for (const auto& event : calendar.events()) {
+        auto& copy = legacy.emplace_back(LegacyEvent {
+            .uid = std::string(event.uid()),
+            .subject = std::string(event.subject()),
+            .type = event.type().transform([](std::string_view type) { return std::string(type); }),
+            .url = event.url().transform([](std::string_view url) { return std::string(url); }),
+            .location = std::monostate(),
+            .start = event.start(),
+            .end = event.end(),
+        });
+        if (event.has_full_location()) {
+            copy.location = LegacyEvent::FullLocation {
+                .room = std::string(event.room().value_or("")),
+                .building = std::string(event.building().value_or("")),
+                .address = std::string(event.address().value_or("")),
+            };
+        } else if (auto address = event.address()) {
+            copy.location = std::string(address.value());
+        }
+
+        legacy_heap += heap_size(copy.uid) + heap_size(copy.subject);
+        legacy_heap += copy.type.has_value() ? heap_size(copy.type.value()) : 0;
+        legacy_heap += copy.url.has_value() ? heap_size(copy.url.value()) : 0;
+        if (const auto* full = std::get_if<LegacyEvent::FullLocation>(&copy.location)) {
+            legacy_heap += heap_size(full->room) + heap_size(full->building) + heap_size(full->address);
+        } else if (const auto* address = std::get_if<std::string>(&copy.location)) {
+            legacy_heap += heap_size(*address);
+        }
+    }
+    const auto legacy_objects = legacy.size() * sizeof(LegacyEvent);
+
+    // Repeated strings are interned once, identifiers and URLs are views into the decoded text.
+    const auto& strings = calendar.strings();
+    const auto record_bytes = calendar.records().size() * sizeof(icalendar::EventRecord);
+    const auto dictionary_bytes = strings.size() * sizeof(std::string_view);
+
+    fmt::print("Old Event objects:   {:4} bytes per event, {:9} bytes\n", sizeof(LegacyEvent), legacy_objects);
+    fmt::print("Old string copies:                       {:9} bytes on the heap\n", legacy_heap);
+    fmt::print("Old total:                               {:9} bytes\n", legacy_objects + legacy_heap);
+    fmt::print("Event records:       {:4} bytes per event, {:9} bytes\n", sizeof(icalendar::EventRecord), record_bytes);
+    fmt::print("Dictionary:        {:6} strings,           {:9} bytes\n", strings.size(), dictionary_bytes);
+    fmt::print("New total:                               {:9} bytes\n", record_bytes + dictionary_bytes);
+    fmt::print("Decoded iCalendar text, needed by both versions, is not counted.\n");
+}
@@ -0,0 +1,138 @@
+/// @file
+/// @brief Measures the throughput of the iCalendar tokenizer: the single-pass preprocess() with vectorized search
+/// of special characters, against the line-by-line preprocess() and regex unescaping it replaced.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <regex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "icalendar/parser.hpp"
+#include "icalendar/scanner.hpp"
+#include "utilities.hpp"
+
+#include "fmt/format.h"
+
+namespace {
+
+    /// @brief The old tokenizer: splits the text into lines, joins folded lines and unescapes them with regexes.
+    /// @param text text of an iCalendar file
+    /// @return lines of the calendar
+    std::vector<std::string> legacy_preprocess(const std::string& text) {
+        std::vector<std::string> lines;
+        for (std::size_t start = 0; start < text.size();) {
+            auto end = text.find('\n', start);
+            end = end == std::string::npos ? text.size() : end;
+            lines.emplace_back(text, start, end - start);
+            start = end + 1;
+        }
+        auto iter = lines.begin();
+        while (iter != lines.end()) {
+            auto current = std::string(usos_rpc::strip(*iter));
+            if (current.empty()) {
+                iter = lines.erase(iter);
+                continue;
+            }
+            if (iter->starts_with(" ")) {
+                auto previous = iter - 1;
+                previous->append(current);
+                iter = lines.erase(iter);
+            } else {
+                *iter = current;
+                iter++;
+            }
+        }
+
+        const std::regex newline(R"(\\n)");
+        const std::regex comma(R"(\\,)");
+        for (auto& line : lines) {
+            line = std::regex_replace(line, newline, "\n");
+            line = std::regex_replace(line, comma, ",");
+        }
+        return lines;
+    }
+
+}
+
+int main() {
+    using namespace usos_rpc;
+    constexpr std::size_t EVENTS = 5'000;
+
+    const auto text = benchmarks::synthetic_calendar(EVENTS);
+    fmt::print("Synthetic calendar: {} events, {} bytes\n", EVENTS, text.size());
+
+    // The new tokenizer also drops DTSTAMP lines, so they are not counted.
+    std::size_t legacy_lines = 0;
+    auto legacy = benchmarks::fastest_run(
+        [&] {
+            auto kept = std::ranges::count_if(legacy_preprocess(text), [](const std::string& line) {
+                return !line.starts_with("DTSTAMP");
+            });
+            legacy_lines = static_cast<std::size_t>(kept);
+        },
+        3
+    );
+
+    // preprocess() decodes the text in place, so every run works on a fresh copy, which is included in the time.
+    std::size_t lines = 0;
+    std::string buffer;
+    std::vector<std::string_view> views;
+    auto single_pass = benchmarks::fastest_run([&] {
+        buffer = text;
+        preprocess(std::span(buffer.data(), buffer.size()), views);
+        lines = views.size();
+    });
+
+    std::size_t scalar_found = 0;
+    auto scalar = benchmarks::fastest_run([&] {
+        scalar_found = 0;
+        for (auto position = text.data(), end = text.data() + text.size(); position != end; position++) {
+            position = find_special_scalar(position, end);
+            if (position == end) {
+                break;
+            }
+            scalar_found++;
+        }
+    });
+
+    std::size_t vector_found = 0;
+    auto vectorized = benchmarks::fastest_run([&] {
+        vector_found = 0;
+        for (auto position = text.data(), end = text.data() + text.size(); position != end; position++) {
+            position = icalendar::find_special_character(position, end);
+            if (position == end) {
+                break;
+            }
+            vector_found++;
+        }
+    });
+
+    std::size_t events = 0;
+    auto parse = benchmarks::fastest_run([&] {
+        events = icalendar::parse(text).records().size();
+    });
+
+    if (legacy_lines != lines || scalar_found != vector_found || events != EVENTS) {
+        fmt::print(
+            "Results differ: {} != {} lines, {} != {} special characters\n",
+            legacy_lines,
+            lines,
+            scalar_found,
+            vector_found
+        );
+        return 1;
+    }
+    auto throughput = [&text](std::chrono::duration<double> duration) {
+        return benchmarks::megabytes_per_second(text.size(), duration);
+    };
+    fmt::print("Old preprocess() + regex unescaping: {:8.1f} MB/s\n", throughput(legacy));
+    fmt::print("Single-pass preprocess():            {:8.1f} MB/s\n", throughput(single_pass));
+    fmt::print("Special character search, scalar:    {:8.1f} MB/s\n", throughput(scalar));
+    fmt::print("Special character search, SIMD:      {:8.1f} MB/s\n", throughput(vectorized));
+    fmt::print("Whole parse():                       {:8.1f} MB/s\n", throughput(parse));
+}
@@ -0,0 +1,104 @@
+/// @file
+/// @brief Compares extracting VEVENT properties in one scan with the perfect-hash property table
+/// against the chain of string prefix searches it replaced.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "icalendar/parser.hpp"
+#include "icalendar/property.hpp"
+
+#include "fmt/format.h"
+
+namespace {
+
+    /// @brief Properties looked up for every event, in the same order as the old parser did.
+    constexpr std::array<std::string_view, 6> EVENT_PROPERTIES {
+        "DTSTART", "DTEND", "SUMMARY", "UID", "DESCRIPTION", "LOCATION",
+    };
+
+    /// @brief The old lookup: a linear search for a line starting with the name, copying the value.
+    /// @param block lines of the event
+    /// @param name property name
+    /// @return property value or nullopt when not found
+    std::optional<std::string> find_with_prefix(std::span<const std::string> block, const std::string& name) {
+        auto line = std::ranges::find_if(block, [&name](const std::string& candidate) {
+            return candidate.starts_with(name);
+        });
+        if (line == block.end()) {
+            return std::nullopt;
+        }
+        return line->substr(name.size() + 1);
+    }
+
+}
+
+int main() {
+    using namespace usos_rpc;
+    constexpr std::size_t EVENTS = 20'000;
+
+    auto text = benchmarks::synthetic_calendar(EVENTS);
+    auto lines = preprocess(std::span(text.data(), text.size()));
+
+    // Lines of every event without BEGIN and END, once as views and once as strings (as in the old parser).
+    std::vector<std::span<const std::string_view>> blocks;
+    std::vector<std::string> line_copies(lines.begin(), lines.end());
+    std::vector<std::span<const std::string>> block_copies;
+    for (std::size_t i = 0; i < lines.size(); i++) {
+        if (lines[i] != "BEGIN:VEVENT") {
+            continue;
+        }
+        auto end = i + 1;
+        while (lines[end] != "END:VEVENT") {
+            end++;
+        }
+        blocks.emplace_back(lines.data() + i + 1, end - i - 1);
+        block_copies.emplace_back(line_copies.data() + i + 1, end - i - 1);
+        i = end;
+    }
+
+    std::size_t prefix_found = 0;
+    auto prefix = benchmarks::fastest_run([&] {
+        prefix_found = 0;
+        for (const auto& block : block_copies) {
+            for (auto name : EVENT_PROPERTIES) {
+                if (find_with_prefix(block, std::string(name)).has_value()) {
+                    prefix_found++;
+                }
+            }
+        }
+    });
+
+    std::size_t table_found = 0;
+    auto table = benchmarks::fastest_run([&] {
+        table_found = 0;
+        for (const auto& block : blocks) {
+            std::array<std::optional<icalendar::ContentLine>, icalendar::PROPERTY_NAMES.size()> properties;
+            for (auto line : block) {
+                auto content = icalendar::split_content_line(line);
+                properties[static_cast<std::size_t>(icalendar::find_property(content.name))] = content;
+            }
+            for (auto name : EVENT_PROPERTIES) {
+                if (properties[static_cast<std::size_t>(icalendar::find_property(name))].has_value()) {
+                    table_found++;
+                }
+            }
+        }
+    });
+
+    if (prefix_found != table_found) {
+        fmt::print("Results differ: {} != {} properties found\n", prefix_found, table_found);
+        return 1;
+    }
+    fmt::print("Events: {}\n", blocks.size());
+    fmt::print("Prefix search per property:  {:8.1f} ns per event\n", benchmarks::nanoseconds_per_item(EVENTS, prefix));
+    fmt::print("One scan with perfect hash:  {:8.1f} ns per event\n", benchmarks::nanoseconds_per_item(EVENTS, table));
+    fmt::print("Speedup: {:.1f}x\n", prefix / table);
+}
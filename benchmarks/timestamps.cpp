@@ -0,0 +1,60 @@
+/// @file
+/// @brief Compares the fixed-format timestamp parser with the stream-based date::parse() it replaced.
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "icalendar/timestamp.hpp"
+
+#include "date/date.h"
+#include "fmt/format.h"
+
+int main() {
+    using namespace usos_rpc;
+    constexpr std::size_t COUNT = 200'000;
+
+    std::vector<std::string> values;
+    values.reserve(COUNT);
+    for (std::size_t i = 0; i < COUNT; i++) {
+        auto month = 1 + i % 12;
+        auto day = 1 + i % 28;
+        auto hour = i % 24;
+        auto minute = i % 60;
+        values.push_back(fmt::format("2024{:02}{:02}T{:02}{:02}00", month, day, hour, minute));
+    }
+
+    // The same code as in the old Event constructor: a stream per value.
+    std::int64_t stream_sum = 0;
+    auto streams = benchmarks::fastest_run([&] {
+        stream_sum = 0;
+        for (const auto& value : values) {
+            std::istringstream stream(value);
+            stream.exceptions(std::ios_base::badbit);
+            date::local_seconds time;
+            stream >> date::parse("%Y%m%dT%H%M%S", time);
+            stream_sum += time.time_since_epoch().count();
+        }
+    });
+
+    std::int64_t fixed_sum = 0;
+    auto fixed = benchmarks::fastest_run([&] {
+        fixed_sum = 0;
+        for (const auto& value : values) {
+            fixed_sum += icalendar::parse_timestamp(value)->time.time_since_epoch().count();
+        }
+    });
+
+    if (stream_sum != fixed_sum) {
+        fmt::print("Results differ: {} != {}\n", stream_sum, fixed_sum);
+        return 1;
+    }
+    fmt::print("Timestamps parsed: {}\n", COUNT);
+    fmt::print("istringstream + date::parse: {:8.1f} ns per value\n", benchmarks::nanoseconds_per_item(COUNT, streams));
+    fmt::print("parse_timestamp:             {:8.1f} ns per value\n", benchmarks::nanoseconds_per_item(COUNT, fixed));
+    fmt::print("Speedup: {:.1f}x\n", streams / fixed);
+}
@@ -3,15 +3,23 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
+#include <cstddef>
 #include <cstdlib>
+#include <exception>
+#include <optional>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "../config.hpp"
 #include "../exceptions.hpp"
+#include "../fetcher.hpp"
 #include "../files.hpp"
+#include "../icalendar/calendar.hpp"
+#include "../icalendar/calendar_diff.hpp"
 #include "../logging.hpp"
 #include "../utilities.hpp"
 #include "build_info.hpp"
@@ -54,44 +62,124 @@ namespace {
         .joinRequest = nullptr,
     };
 
+    /// @brief Prints the result of a calendar refresh, with the list of changed events if it is short.
+    /// @param diff changed events or nullopt if the calendar has not changed
+    /// @param source index of the refreshed calendar source
+    void print_refresh_result(
+        const std::optional<usos_rpc::icalendar::CalendarDiff>& diff,
+        const usos_rpc::Config& config,
+        std::size_t source
+    ) {
+        using namespace usos_rpc;
+        constexpr std::size_t MAX_LISTED_CHANGES = 10;  // Longer lists (e.g. a new semester) are only counted.
+
+        if (diff.has_value()) {
+            lprint(colors::SUCCESS, "Calendar data has been refreshed successfully:\n");
+            lprint("{}\n", config.calendars()[source].name());
+            if (!diff->empty()) {
+                using enum icalendar::ChangeType;
+                lprint(
+                    "Events added: {}, removed: {}, rescheduled: {}, relocated: {}\n",
+                    diff->count(ADDED),
+                    diff->count(REMOVED),
+                    diff->count(RESCHEDULED),
+                    diff->count(RELOCATED)
+                );
+                if (diff->changes.size() <= MAX_LISTED_CHANGES) {
+                    for (const auto& change : diff->changes) {
+                        lprint("{}", change);
+                    }
+                }
+            }
+        } else {
+            lprint("Nothing has changed in the calendar since the last check.\n");
+            const auto& cache = config.http_cache(source);
+            if (cache.not_modified > 0) {
+                lprint(
+                    "The server has reported no changes {} time{} so far, saving {} kB of downloads.\n",
+                    cache.not_modified,
+                    cache.not_modified > 1 ? "s" : "",
+                    cache.saved_bytes / 1024
+                );
+            }
+        }
+        if (auto timings = config.http_timings(source)) {
+            lprint("Request timings: {}\n", *timings);
+        }
+    }
+
     /// @brief Service loop contents.
     /// @param next time of next update
-    void update_presence(std::chrono::time_point<std::chrono::system_clock>& next, usos_rpc::Config& config) {
+    /// @param fetcher calendars being fetched in the background
+    void update_presence(
+        std::chrono::time_point<std::chrono::system_clock>& next,
+        usos_rpc::Config& config,
+        usos_rpc::CalendarFetcher& fetcher
+    ) {
         using namespace usos_rpc;
         constexpr std::chrono::seconds DESYNC_DELAY(3);  // Delay to make sure no desyncs happen.
 
         auto now = std::chrono::system_clock::now();
-        if (next < now) {
+        bool outdated = false;
+        for (auto& result : fetcher.take_results()) {
             try {
-                lprint("Refreshing calendar data...\n");
-                bool changed = config.refresh_calendar();
-                if (changed) {
-                    lprint(colors::SUCCESS, "Calendar data has been refreshed successfully:\n");
-                    lprint("{}\n", config.calendar().name());
-                } else {
-                    lprint("Nothing has changed in the calendar since the last check.\n");
+                if (result.error) {
+                    std::rethrow_exception(result.error);
+                }
+                // The presence is shown again only if current or upcoming events have changed.
+                auto horizon = std::chrono::system_clock::time_point::max();
+                if (auto upcoming = config.calendars().next_event(now)) {
+                    horizon = std::max<std::chrono::system_clock::time_point>(upcoming->utc_start(), now);
+                }
+                auto diff = result.calendar.has_value()
+                                ? config.replace_calendar(result.source, std::move(result.calendar.value()))
+                                : std::nullopt;
+                print_refresh_result(diff, config, result.source);
+                if (diff.has_value() && diff->affects(now, horizon)) {
+                    outdated = true;
+                    next = now;
                 }
             } catch (const Exception&) {
                 eprint(colors::WARNING, "Calendar refresh failed!\n");
             }
+        }
 
-            lprint(
-                colors::OTHER,
-                "Update interval reached at {}\n",
-                date::format("%Y-%m-%d %H:%M", date::zoned_time(date::current_zone(), next))
-            );
-
-            auto maybe_event = config.calendar().next_event();
-            if (maybe_event.has_value()) {
-                auto event = maybe_event.value();
-                if (event->start(config.calendar().time_zone()).get_sys_time() < now) {
-                    Discord_UpdatePresence(config.create_presence_object(*event));
-                    auto until_end = event->end(config.calendar().time_zone()).get_sys_time() - now;
-                    next += min_duration(config.idle_refresh_rate(), until_end + DESYNC_DELAY);
-                    lprint("Current event:\n{}", *event);
+        // Without a snapshot there is nothing to show until the first refresh is finished.
+        bool loaded = false;
+        for (std::size_t source = 0; source < config.calendars().size(); source++) {
+            loaded = loaded || config.calendars()[source].fingerprint() != icalendar::ContentFingerprint();
+        }
+        // New data is shown in the same tick, as on the next one it would look like a scheduled update
+        // and start another, pointless refresh.
+        if (outdated || (next < now && (loaded || !fetcher.in_flight()))) {
+            if (outdated) {
+                lprint(colors::OTHER, "Current or upcoming events have changed\n");
+            } else {
+                if (fetcher.refresh()) {
+                    lprint("Refreshing calendar data in the background...\n");
+                }
+                lprint(
+                    colors::OTHER,
+                    "Update interval reached at {}\n",
+                    date::format("%Y-%m-%d %H:%M", date::zoned_time(date::current_zone(), next))
+                );
+            }
+
+            auto event = config.calendars().next_event(now);
+            if (event.has_value()) {
+                if (event->utc_start() < now) {
+                    // Overlapping events are shown together, the first one has not ended yet, so it is among them.
+                    auto current = config.calendars().events_at(now);
+                    Discord_UpdatePresence(config.create_presence_object(current));
+                    auto first_end = std::ranges::min(current, {}, &icalendar::EventRef::utc_end).utc_end();
+                    next += min_duration(config.idle_refresh_rate(), first_end - now + DESYNC_DELAY);
+                    lprint("Current event{}:\n", current.size() > 1 ? "s" : "");
+                    for (const auto& current_event : current) {
+                        lprint("{}", current_event);
+                    }
                 } else {
                     Discord_ClearPresence();
-                    auto until_start = event->start(config.calendar().time_zone()).get_sys_time() - now;
+                    auto until_start = event->utc_start() - now;
                     next += min_duration(config.idle_refresh_rate(), until_start + DESYNC_DELAY);
                     if (until_start < std::chrono::days(1)) {
                         lprint("Next event in {:.0%H:%M:%S}\n", until_start);
@@ -122,6 +210,7 @@ namespace {
 /// @param signal ignored
 extern "C" void ctrl_c_signal_handler(int signal) {
     ctrl_c_detected = 1;
+    usos_rpc::cancel_requests();  // Downloads in flight are aborted instead of delaying the exit.
 }
 
 namespace usos_rpc::commands {
@@ -134,6 +223,17 @@ namespace usos_rpc::commands {
         auto config = read_config();
         lprint(colors::SUCCESS, "Configuration file has been read successfully!\n");
 
+        // The presence is shown from the last snapshots right away, while the calendars are fetched in the background.
+        if (config.load_snapshot()) {
+            lprint(colors::SUCCESS, "Calendar snapshot has been loaded:\n");
+            for (std::size_t source = 0; source < config.calendars().size(); source++) {
+                lprint("{}\n", config.calendars()[source].name());
+            }
+        }
+        CalendarFetcher fetcher(config);
+        fetcher.refresh();
+        lprint("Refreshing calendar data in the background...\n");
+
         std::signal(SIGINT, ctrl_c_signal_handler);
         std::signal(SIGTERM, ctrl_c_signal_handler);
         Discord_Initialize(config.discord_app_id().c_str(), &handlers, false, nullptr);
@@ -145,7 +245,7 @@ namespace usos_rpc::commands {
             auto next_update = std::chrono::system_clock::now();
             while (!ctrl_c_detected) {
                 std::this_thread::sleep_for(CALLBACK_DELAY);
-                update_presence(next_update, config);
+                update_presence(next_update, config, fetcher);
             }
         } catch (...) {
             Discord_Shutdown();
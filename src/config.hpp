@@ -3,16 +3,27 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
 #include <optional>
+#include <span>
 #include <regex>
 #include <string>
+#include <system_error>
+#include <vector>
 
 #include "exceptions.hpp"
 #include "files.hpp"
 #include "icalendar/calendar.hpp"
+#include "icalendar/calendar_diff.hpp"
+#include "icalendar/calendar_set.hpp"
 #include "icalendar/parser.hpp"
+#include "icalendar/snapshot.hpp"
+#include "icalendar/stream_parser.hpp"
 #include "requests.hpp"
 
 #include "discord_rpc.h"
@@ -22,40 +33,139 @@ namespace {
 
     /// @brief Regular expression for a valid Discord identifier (uint64_t).
     const std::regex DISCORD_ID(R"(\d{1,20})");
-    /// @brief Regular expression for removing DTSTAMP occurences.
-    const std::regex DTSTAMP(R"(\nDTSTAMP;VALUE=DATE-TIME:\d{8}T\d{6}Z?\r?\n)");
 
 }
 
 namespace usos_rpc {
 
+    /// @brief HTTP cache state of a calendar source, saved next to its snapshot.
+    struct HttpCacheState {
+        /// @brief Validators of the last full response.
+        HttpValidators validators;
+        /// @brief Fingerprint of the body of the last full response, which the validators describe.
+        icalendar::ContentFingerprint fingerprint;
+        /// @brief Size of the body of the last full response.
+        std::uint64_t size = 0;
+        /// @brief Number of requests answered with 304 Not Modified since the start, not saved.
+        std::uint64_t not_modified = 0;
+        /// @brief Number of bytes which did not have to be downloaded thanks to 304 responses since the start,
+        /// not saved.
+        std::uint64_t saved_bytes = 0;
+    };
+
     /// @brief Represents config.toml structure. For more info, open the default file in resources directory.
     class Config {
-        /// @brief iCalendar file path or http/webcal link.
-        std::string _calendar_location;
+        /// @brief iCalendar file paths or http/webcal links, one per calendar source.
+        std::vector<std::string> _calendar_locations;
         /// @brief Discord Rich Presence application identifier.
         /// @see https://discord.com/developers/applications
         std::string _discord_app_id;
         /// @brief Calendar data refresh rate when idle (no upcoming events in the nearest future).
         std::int64_t _idle_refresh_rate = 30;
 
+        /// @brief Number of threads used to parse events, 0 means the number of logical processors.
+        std::int64_t _parser_threads = 0;
+        /// @brief Minimal calendar size (in kilobytes) for which events are parsed in parallel.
+        std::int64_t _parallel_parsing_threshold = 512;
+        /// @brief Minimal calendar file size (in kilobytes) for which the file is mapped into memory instead of read.
+        std::int64_t _file_mapping_threshold = 16;
+        /// @brief Number of days ahead for which events are kept, 0 means all events.
+        std::int64_t _parse_horizon_days = 0;
+        /// @brief Maximal time (in seconds) of connecting to a calendar server, 0 means no limit.
+        std::int64_t _connect_timeout = 10;
+        /// @brief Maximal time (in seconds) of a whole calendar download, 0 means no limit.
+        std::int64_t _request_timeout = 120;
+        /// @brief Download speed (in bytes per second) below which a download is aborted after _low_speed_time.
+        std::int64_t _low_speed_limit = 100;
+        /// @brief Number of seconds a download may stay below _low_speed_limit, 0 disables the limit.
+        std::int64_t _low_speed_time = 30;
+
         /// @brief Temporary solution for global large image key.
         std::optional<std::string> _image_key;
 
-        /// @brief iCalendar file hash.
-        std::size_t _calendar_hash;
-        /// @brief Parsed calendar structure.
-        icalendar::Calendar _calendar;
+        /// @brief Parsed calendar structures, one per calendar source.
+        icalendar::CalendarSet _calendars;
+        /// @brief HTTP cache states, one per calendar source.
+        std::vector<HttpCacheState> _http_caches;
+        /// @brief HTTP cache states of fetched calendars which have not replaced the cached ones yet,
+        /// one per calendar source.
+        std::vector<std::optional<HttpCacheState>> _pending_http_caches;
+        /// @brief HTTP clients kept between refreshes, one per calendar source, nullptr for files.
+        std::vector<std::unique_ptr<HttpClient>> _http_clients;
+
+        /// @brief Loads the HTTP cache state of a calendar source, if it was saved.
+        /// @param source index of the calendar source
+        void load_http_cache(std::size_t source) {
+            std::ifstream reader(http_cache_path(source), std::ios::binary);
+            HttpCacheState cache;
+            reader >> std::hex >> cache.fingerprint.low >> cache.fingerprint.high >> std::dec >> cache.size;
+            reader.ignore();
+            std::getline(reader, cache.validators.etag);
+            std::getline(reader, cache.validators.last_modified);
+            if (reader) {
+                _http_caches[source] = std::move(cache);
+            }
+        }
+
+        /// @brief Saves the HTTP cache state of a calendar source.
+        /// @param source index of the calendar source
+        void save_http_cache(std::size_t source) const {
+            const auto& cache = _http_caches[source];
+            try {
+                write_file(
+                    http_cache_path(source).string(),
+                    fmt::format(
+                        "{:x} {:x} {}\n{}\n{}\n",
+                        cache.fingerprint.low,
+                        cache.fingerprint.high,
+                        cache.size,
+                        cache.validators.etag,
+                        cache.validators.last_modified
+                    )
+                );
+            } catch (const Exception&) {}  // Only an optimization, like the snapshot, the exception is already logged.
+        }
+
+        /// @brief Makes the pending HTTP cache state of a calendar source current and saves it,
+        /// once the calendar it describes has been stored.
+        /// @param source index of the calendar source
+        void commit_http_cache(std::size_t source) {
+            auto& pending = _pending_http_caches[source];
+            if (!pending.has_value()) {
+                return;
+            }
+            auto& cache = _http_caches[source];
+            cache.validators = std::move(pending->validators);
+            cache.fingerprint = pending->fingerprint;
+            cache.size = pending->size;
+            pending.reset();
+            save_http_cache(source);
+        }
 
     public:
         /// @brief Constructs an object based on parsed TOML data.
         /// @param parsed_file TOML data for config.toml
         /// @throws usos_rpc::Exception when the necessary properties are invalid or not found
-        explicit Config(const toml::table& parsed_file): _calendar_hash() {
-            auto cal = parsed_file.get_as<std::string>("calendar");
-            if (!cal || (_calendar_location = cal->get()).size() == 0) {
+        explicit Config(const toml::table& parsed_file) {
+            if (auto sources = parsed_file.get_as<toml::array>("calendar")) {
+                for (const auto& source : *sources) {
+                    auto location = source.value<std::string>();
+                    if (!location || location->size() == 0) {
+                        throw Exception(
+                            ExceptionType::CONFIG, "Invalid 'calendar' property! Please fix the config file."
+                        );
+                    }
+                    _calendar_locations.push_back(std::move(location.value()));
+                }
+            } else if (auto cal = parsed_file.get_as<std::string>("calendar"); cal && cal->get().size() > 0) {
+                _calendar_locations.push_back(cal->get());
+            }
+            if (_calendar_locations.empty()) {
                 throw Exception(ExceptionType::CONFIG, "Empty 'calendar' property! Please fix the config file.");
             }
+            _calendars = icalendar::CalendarSet(_calendar_locations.size());
+            _http_caches.resize(_calendar_locations.size());
+            _pending_http_caches.resize(_calendar_locations.size());
 
             auto raw_app_id = parsed_file.get("discord_app_id");
             if (!raw_app_id) {
@@ -87,50 +197,246 @@ namespace usos_rpc {
                 _idle_refresh_rate = refresh->get();
             }
 
+            auto threads = parsed_file.get_as<std::int64_t>("parser_threads");
+            if (threads && threads->get() >= 0) {
+                _parser_threads = threads->get();
+            }
+
+            auto threshold = parsed_file.get_as<std::int64_t>("parallel_parsing_threshold");
+            if (threshold && threshold->get() >= 0) {
+                _parallel_parsing_threshold = threshold->get();
+            }
+
+            auto mapping_threshold = parsed_file.get_as<std::int64_t>("file_mapping_threshold");
+            if (mapping_threshold && mapping_threshold->get() >= 0) {
+                _file_mapping_threshold = mapping_threshold->get();
+            }
+
+            auto horizon = parsed_file.get_as<std::int64_t>("parse_horizon_days");
+            if (horizon && horizon->get() >= 0) {
+                _parse_horizon_days = horizon->get();
+            }
+
+            auto connect_timeout = parsed_file.get_as<std::int64_t>("connect_timeout");
+            if (connect_timeout && connect_timeout->get() >= 0) {
+                _connect_timeout = connect_timeout->get();
+            }
+
+            auto request_timeout = parsed_file.get_as<std::int64_t>("request_timeout");
+            if (request_timeout && request_timeout->get() >= 0) {
+                _request_timeout = request_timeout->get();
+            }
+
+            auto low_speed_limit = parsed_file.get_as<std::int64_t>("low_speed_limit");
+            if (low_speed_limit && low_speed_limit->get() >= 0) {
+                _low_speed_limit = low_speed_limit->get();
+            }
+
+            auto low_speed_time = parsed_file.get_as<std::int64_t>("low_speed_time");
+            if (low_speed_time && low_speed_time->get() >= 0) {
+                _low_speed_time = low_speed_time->get();
+            }
+
             auto key = parsed_file.get_as<std::string>("image_key");
             if (key && key->get().size() > 0) {
                 _image_key = key->get();
             }
+
+            const HttpLimits limits {
+                .connect_timeout = std::chrono::seconds(_connect_timeout),
+                .total_timeout = std::chrono::seconds(_request_timeout),
+                .low_speed_limit = _low_speed_limit,
+                .low_speed_time = std::chrono::seconds(_low_speed_time),
+            };
+            for (const auto& location : _calendar_locations) {
+                auto is_http = http_url(location).has_value();
+                _http_clients.push_back(is_http ? std::make_unique<HttpClient>(limits) : nullptr);
+            }
+        }
+
+        /// @brief Downloads or reads a calendar and parses it, without changing the cached calendar.
+        /// Nothing is returned if the fingerprint of the data matches the previous version, in which case the data
+        /// is not parsed at all, and it is not even downloaded if the server confirms that it has not changed
+        /// since the previous version.
+        /// Can be called from another thread, as long as neither the previous calendar nor the HTTP cache state
+        /// of the source are used meanwhile.
+        /// @param source index of the calendar source
+        /// @param previous calendar to compare with and reuse unchanged events from, or nullptr
+        /// @param multi event loop to download the calendar on, nullptr to block the calling thread
+        /// @return parsed calendar or nullopt if the data is the same as in the previous version
+        /// @throws usos_rpc::Exception when reading or parsing calendar data fails
+        [[nodiscard]]
+        std::optional<icalendar::Calendar> fetch_calendar(
+            std::size_t source,
+            const icalendar::Calendar* previous,
+            HttpMulti* multi = nullptr
+        ) {
+            const auto& location = _calendar_locations[source];
+            const auto options = parse_options();
+            auto unchanged = [previous, &options](icalendar::ContentFingerprint fingerprint) {
+                return previous != nullptr
+                       && icalendar::windowed_fingerprint(fingerprint, options) == previous->fingerprint();
+            };
+
+            auto url = http_url(location);
+            if (url.has_value()) {
+                auto& cache = _http_caches[source];
+                _pending_http_caches[source].reset();
+                // Validators describe the previous version only if they came with exactly the same data.
+                auto validators = unchanged(cache.fingerprint) ? cache.validators : HttpValidators();
+                // Without a previous version there is nothing to compare with, so events are parsed while the rest
+                // of the calendar is still being downloaded. Otherwise the data is only fingerprinted while it arrives,
+                // as usually it has not changed, and it is parsed only if the fingerprint shows that it has.
+                std::optional<icalendar::StreamParser> parser;
+                if (previous == nullptr || previous->fingerprint() == icalendar::ContentFingerprint()) {
+                    parser.emplace(previous, options);
+                }
+                icalendar::ContentHasher hasher;
+                std::string contents;
+                std::uint64_t size = 0;
+                auto modified = _http_clients[source]->get(
+                    url->c_str(),
+                    [&parser, &hasher, &contents, &size](std::string_view chunk) {
+                        if (parser.has_value()) {
+                            parser->feed(chunk);
+                        } else {
+                            hasher.feed(chunk);
+                            contents.append(chunk);
+                        }
+                        size += chunk.size();
+                    },
+                    validators,
+                    multi
+                );
+                if (!modified) {
+                    cache.not_modified++;
+                    cache.saved_bytes += cache.size;
+                    return std::nullopt;
+                }
+                auto fingerprint = parser.has_value() ? parser->content_fingerprint() : hasher.finish();
+                if (unchanged(fingerprint)) {
+                    // The response describes the calendar which is already stored.
+                    cache.validators = std::move(validators);
+                    cache.fingerprint = fingerprint;
+                    cache.size = size;
+                    save_http_cache(source);
+                    return std::nullopt;
+                }
+                auto calendar = parser.has_value() ? parser->finish() : icalendar::parse(contents, options, previous);
+                // Saved by replace_calendar(), so that a calendar which fails to parse or to be stored
+                // is not skipped next time because of its validators.
+                auto& pending = _pending_http_caches[source];
+                pending.emplace();
+                pending->validators = std::move(validators);
+                pending->fingerprint = fingerprint;
+                pending->size = size;
+                return calendar;
+            }
+            auto threshold = static_cast<std::size_t>(_file_mapping_threshold) * 1024;
+            return with_file_contents(
+                location,
+                threshold,
+                [&unchanged, &options, previous](std::string_view contents) -> std::optional<icalendar::Calendar> {
+                    if (unchanged(icalendar::content_fingerprint(contents))) {
+                        return std::nullopt;
+                    }
+                    return icalendar::parse(contents, options, previous);
+                }
+            );
         }
 
-        /// @brief Refreshes cached calendar structure based on the given link if its hash has changed.
-        /// @return true if refresh was necessary, false if nothing has changed
+        /// @brief Replaces cached calendar structure of a source if the new one is different, and saves its snapshot
+        /// together with the HTTP cache state of the response it came from. Calendars of other sources are left
+        /// as they are.
+        /// @param source index of the calendar source
+        /// @param calendar freshly fetched calendar
+        /// @return changed events or nullopt if the calendar has not changed
+        std::optional<icalendar::CalendarDiff> replace_calendar(std::size_t source, icalendar::Calendar&& calendar) {
+            if (calendar.fingerprint() == _calendars[source].fingerprint()) {
+                commit_http_cache(source);
+                return std::nullopt;
+            }
+            auto diff = icalendar::diff_calendars(_calendars[source], calendar);
+            // The old calendar might be mapped from the snapshot file, so it is released first.
+            _calendars.replace(source, std::move(calendar));
+            try {
+                icalendar::save_snapshot(
+                    _calendars[source],
+                    snapshot_path(source),
+                    icalendar::fingerprint(_calendar_locations[source])
+                );
+            } catch (const Exception&) {}  // The snapshot is only an optimization, the exception is already logged.
+            commit_http_cache(source);
+            return diff;
+        }
+
+        /// @brief Refreshes cached calendar structure of a source if its hash has changed.
+        /// @param source index of the calendar source
+        /// @return changed events or nullopt if nothing has changed
         /// @throws usos_rpc::Exception when reading or parsing calendar data fails
-        bool refresh_calendar() {
-            auto cal_raw = fetch_content(_calendar_location);
-            // Remove DTSTAMP properties because they always change and mess up hashing.
-            auto cal = std::regex_replace(cal_raw, DTSTAMP, "\n");
+        std::optional<icalendar::CalendarDiff> refresh_calendar(std::size_t source) {
+            // Unchanged events are reused from the current version.
+            auto calendar = fetch_calendar(source, &_calendars[source]);
+            if (!calendar.has_value()) {
+                return std::nullopt;
+            }
+            return replace_calendar(source, std::move(calendar.value()));
+        }
 
-            auto new_hash = std::hash<std::string> {}(cal);
-            if (new_hash != _calendar_hash) {
-                _calendar = icalendar::parse(cal);
-                _calendar_hash = new_hash;
-                return true;
+        /// @brief Loads cached calendar structures from the snapshots of the last successfully fetched calendars.
+        /// @return true if a valid snapshot was found for any of the configured calendars
+        bool load_snapshot() {
+            bool loaded = false;
+            for (std::size_t source = 0; source < _calendar_locations.size(); source++) {
+                auto path = snapshot_path(source);
+                std::error_code error;
+                if (!std::filesystem::exists(path, error)) {
+                    continue;
+                }
+                try {
+                    auto location = icalendar::fingerprint(_calendar_locations[source]);
+                    auto calendar = icalendar::load_snapshot(path, location);
+                    if (calendar.has_value()) {
+                        _calendars.replace(source, std::move(calendar.value()));
+                        load_http_cache(source);
+                        loaded = true;
+                    }
+                } catch (const Exception&) {}  // Already logged, the calendar will be fetched anyway.
             }
-            return false;
+            return loaded;
         }
 
-        /// @brief Creates Discord Rich Presence representation based on given event.
-        /// @param event current event
+        /// @brief Creates Discord Rich Presence representation based on given events, which are happening at once.
+        /// @param events current events in order of start time, at least one
         /// @return Rich Presence object
         [[nodiscard]]
-        const DiscordRichPresence* create_presence_object(const usos_rpc::icalendar::Event& event) {
+        const DiscordRichPresence* create_presence_object(std::span<const icalendar::EventRef> events) {
             // Caching objects to not create dangling pointers
             static std::string subject;
             static std::optional<std::string> location;
             static DiscordRichPresence presence;
 
-            subject = event.type().has_value()
-                ? fmt::format("{} - {}", event.subject(), event.type().value())
-                : event.subject();
-            location = event.has_full_location()
-                ? std::optional(fmt::format("{} - {}", *event.room(), *event.building()))
-                : std::nullopt;
+            subject.clear();
+            location.reset();
+            for (const auto& event : events) {
+                if (!subject.empty()) {
+                    subject += " | ";
+                }
+                subject += event.type().has_value()
+                    ? fmt::format("{} - {}", event.subject(), event.type().value())
+                    : std::string(event.subject());
+                if (event.has_full_location()) {
+                    location = location.has_value() ? *location + " | " : std::string();
+                    *location += fmt::format("{} - {}", *event.room(), *event.building());
+                }
+            }
+            // The presence lasts until the first of the events ends, as it has to change then.
+            auto first_to_end = std::ranges::min(events, {}, &icalendar::EventRef::utc_end);
             presence = {
                 .state = location.transform(&std::string::c_str).value_or(nullptr),
                 .details = subject.c_str(),
-                .startTimestamp = event.start(_calendar.time_zone()).get_sys_time().time_since_epoch().count(),
-                .endTimestamp = event.end(_calendar.time_zone()).get_sys_time().time_since_epoch().count(),
+                .startTimestamp = events.front().utc_start().time_since_epoch().count(),
+                .endTimestamp = first_to_end.utc_end().time_since_epoch().count(),
                 .largeImageKey = _image_key.transform(&std::string::c_str).value_or(nullptr),
                 .largeImageText = nullptr,
                 .smallImageKey = nullptr,
@@ -148,16 +454,16 @@ namespace usos_rpc {
             return &presence;
         }
 
-        /// @brief Returns parsed calendar structure, cached in this object.
+        /// @brief Returns parsed calendar structures of all sources, cached in this object.
         [[nodiscard]]
-        const icalendar::Calendar& calendar() const {
-            return _calendar;
+        const icalendar::CalendarSet& calendars() const {
+            return _calendars;
         }
 
-        /// @brief Returns parsed calendar structure, cached in this object.
+        /// @brief Returns parsed calendar structures of all sources, cached in this object.
         [[nodiscard]]
-        icalendar::Calendar& calendar() {
-            return _calendar;
+        icalendar::CalendarSet& calendars() {
+            return _calendars;
         }
 
         /// @brief Returns chosen idle calendar refresh rate.
@@ -166,10 +472,61 @@ namespace usos_rpc {
             return std::chrono::minutes(_idle_refresh_rate);
         }
 
-        /// @brief Returns chosen calendar path/link.
+        /// @brief Returns iCalendar parser settings based on the config.
+        /// The event window is aligned to whole days, so that it moves only once a day.
+        [[nodiscard]]
+        icalendar::ParseOptions parse_options() const {
+            icalendar::ParseOptions options {
+                .threads = static_cast<unsigned>(_parser_threads),
+                .parallel_threshold = static_cast<std::size_t>(_parallel_parsing_threshold) * 1024,
+            };
+            if (_parse_horizon_days > 0) {
+                auto today = std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now());
+                options.window_begin = today - std::chrono::days(1);
+                options.window_end = today + std::chrono::days(_parse_horizon_days + 1);
+            }
+            return options;
+        }
+
+        /// @brief Returns path of the snapshot file of a calendar source.
+        /// The first source uses the same file as when only one source was supported.
+        /// @param source index of the calendar source
+        [[nodiscard]]
+        std::filesystem::path snapshot_path(std::size_t source) const {
+            auto name = source == 0 ? std::string("calendar.snapshot") : fmt::format("calendar-{}.snapshot", source);
+            return *get_config_directory() / name;
+        }
+
+        /// @brief Returns path of the file with the HTTP cache state of a calendar source, next to its snapshot.
+        /// @param source index of the calendar source
+        [[nodiscard]]
+        std::filesystem::path http_cache_path(std::size_t source) const {
+            return snapshot_path(source).replace_extension(".http");
+        }
+
+        /// @brief Returns durations of the phases of the last request for a calendar source.
+        /// @param source index of the calendar source
+        /// @return timings or nullopt if the source is a file
+        [[nodiscard]]
+        std::optional<HttpTimings> http_timings(std::size_t source) const {
+            if (_http_clients[source] == nullptr) {
+                return std::nullopt;
+            }
+            return _http_clients[source]->last_timings();
+        }
+
+        /// @brief Returns the HTTP cache state of a calendar source, with counters of requests
+        /// which did not have to download the calendar again.
+        /// @param source index of the calendar source
+        [[nodiscard]]
+        const HttpCacheState& http_cache(std::size_t source) const {
+            return _http_caches[source];
+        }
+
+        /// @brief Returns chosen calendar paths/links, one per calendar source.
         [[nodiscard]]
-        const std::string& calendar_location() const {
-            return _calendar_location;
+        const std::vector<std::string>& calendar_locations() const {
+            return _calendar_locations;
         }
 
         /// @brief Returns chosen Discord app identifier.
@@ -0,0 +1,140 @@
+/// @file
+/// @brief Fetching of calendars on a dedicated I/O thread.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "icalendar/calendar.hpp"
+#include "requests.hpp"
+
+namespace usos_rpc {
+
+    /// @brief Fetches calendars of all sources on a dedicated I/O thread, which drives downloads with
+    /// an usos_rpc::HttpMulti event loop, so that the service loop never waits for the network or the parser.
+    /// At most one refresh is in flight at a time. Its results are handed over source by source, and the service
+    /// loop keeps using the current calendars until it takes them.
+    class CalendarFetcher {
+    public:
+        /// @brief Result of fetching the calendar of a single source.
+        struct Result {
+            /// @brief Index of the calendar source.
+            std::size_t source;
+            /// @brief Fetched calendar, nullopt if it has not changed or the fetch has failed.
+            std::optional<icalendar::Calendar> calendar;
+            /// @brief Exception thrown by the fetch (already logged), nullptr if it has succeeded.
+            std::exception_ptr error;
+        };
+
+    private:
+        /// @brief Configuration with calendar sources, whose calendars are replaced only by the service loop.
+        Config& _config;
+        /// @brief Event loop of all downloads.
+        HttpMulti _multi;
+        /// @brief Protects all of the following members.
+        std::mutex _mutex;
+        /// @brief Wakes up the I/O thread when a refresh is requested or the fetcher is destroyed.
+        std::condition_variable _wake;
+        /// @brief Whether a refresh has been requested and not yet started.
+        bool _requested = false;
+        /// @brief Whether the I/O thread is fetching calendars.
+        bool _running = false;
+        /// @brief Whether the I/O thread should exit.
+        bool _stopping = false;
+        /// @brief Results which have not been taken yet.
+        std::vector<Result> _results;
+        /// @brief I/O thread, started last.
+        std::thread _thread;
+
+        /// @brief Body of the I/O thread.
+        void run() {
+            std::unique_lock lock(_mutex);
+            while (true) {
+                _wake.wait(lock, [this] {
+                    return _requested || _stopping;
+                });
+                if (_stopping) {
+                    return;
+                }
+                _requested = false;
+                _running = true;
+                lock.unlock();
+
+                for (std::size_t source = 0; source < _config.calendars().size(); source++) {
+                    Result result { .source = source, .calendar = std::nullopt, .error = nullptr };
+                    try {
+                        // The calendar of this source is not replaced until its result is taken.
+                        result.calendar = _config.fetch_calendar(source, &_config.calendars()[source], &_multi);
+                    } catch (...) {
+                        result.error = std::current_exception();
+                    }
+                    std::lock_guard result_lock(_mutex);
+                    _results.push_back(std::move(result));
+                }
+
+                lock.lock();
+                _running = false;
+            }
+        }
+
+    public:
+        /// @brief Starts the I/O thread, which waits for a refresh to be requested.
+        /// @param config configuration with calendar sources, which must outlive the fetcher
+        /// @throws usos_rpc::Exception when libcurl cannot be initialized
+        explicit CalendarFetcher(Config& config): _config(config), _thread(&CalendarFetcher::run, this) {}
+
+        CalendarFetcher(const CalendarFetcher&) = delete;
+        CalendarFetcher& operator=(const CalendarFetcher&) = delete;
+
+        /// @brief Aborts the current download and waits for the I/O thread to exit.
+        ~CalendarFetcher() {
+            {
+                std::lock_guard lock(_mutex);
+                _stopping = true;
+            }
+            _multi.stop();
+            _wake.notify_one();
+            _thread.join();
+        }
+
+        /// @brief Requests a refresh of calendars of all sources, unless one is already in flight.
+        /// A refresh is in flight until all of its results have been taken.
+        /// @return true if the refresh has been started
+        bool refresh() {
+            {
+                std::lock_guard lock(_mutex);
+                if (_requested || _running || !_results.empty()) {
+                    return false;
+                }
+                _requested = true;
+            }
+            _wake.notify_one();
+            return true;
+        }
+
+        /// @brief Checks whether a refresh is in flight.
+        /// @return result of the check
+        [[nodiscard]]
+        bool in_flight() {
+            std::lock_guard lock(_mutex);
+            return _requested || _running || !_results.empty();
+        }
+
+        /// @brief Takes results of the refresh in flight which have arrived so far, never waiting for the rest.
+        /// @return results in order of sources
+        [[nodiscard]]
+        std::vector<Result> take_results() {
+            std::lock_guard lock(_mutex);
+            return std::exchange(_results, {});
+        }
+    };
+
+}
@@ -7,6 +7,10 @@
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
 
 #include "exceptions.hpp"
 
@@ -14,8 +18,11 @@
     #include <shlobj.h>
     #include <windows.h>
 #else
+    #include <fcntl.h>
     #include <limits.h>
     #include <pwd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
     #include <unistd.h>
 #endif
 
@@ -119,6 +126,134 @@ namespace usos_rpc {
         }
     }
 
+    /// @brief Read-only memory mapping of a whole file. The file is read lazily by the operating system,
+    /// without copying it into a separate buffer.
+    class MappedFile {
+        /// @brief Beginning of the mapping, nullptr for empty files.
+        const char* _data = nullptr;
+        /// @brief File size.
+        std::size_t _size = 0;
+
+        MappedFile() = default;
+
+        /// @brief Maps the file into memory.
+        /// @param path file path to map
+        /// @return false when opening or mapping the file fails
+        bool map(const std::string& path) {  // clang-format off
+            #ifdef _WIN32
+                auto file = CreateFileW(
+                    std::filesystem::path(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+                );
+                LARGE_INTEGER size;
+                if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+                    if (file != INVALID_HANDLE_VALUE) {
+                        CloseHandle(file);
+                    }
+                    return false;
+                }
+                _size = static_cast<std::size_t>(size.QuadPart);
+                if (_size > 0) {
+                    // The view keeps the file and the mapping object alive, so both handles can be closed.
+                    auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if (mapping != nullptr) {
+                        _data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                        CloseHandle(mapping);
+                    }
+                }
+                CloseHandle(file);
+            #else
+                auto file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat info;
+                if (file < 0 || fstat(file, &info) != 0) {
+                    if (file >= 0) {
+                        close(file);
+                    }
+                    return false;
+                }
+                _size = static_cast<std::size_t>(info.st_size);
+                if (_size > 0) {
+                    // The mapping keeps the file alive, so the descriptor can be closed.
+                    auto mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+                    if (mapping != MAP_FAILED) {
+                        madvise(mapping, _size, MADV_SEQUENTIAL);
+                        _data = static_cast<const char*>(mapping);
+                    }
+                }
+                close(file);
+            #endif
+            return _size == 0 || _data != nullptr;
+        }  // clang-format on
+
+    public:
+        /// @brief Maps the file into memory.
+        /// @param path file path to map
+        /// @throws usos_rpc::Exception when opening or mapping the file fails
+        explicit MappedFile(const std::string& path) {
+            if (!map(path)) {
+                throw Exception(ExceptionType::IO, "Cannot map file contents ({})!", path);
+            }
+        }
+
+        /// @brief Maps the file into memory if possible, without reporting failures,
+        /// for callers which can read the file instead.
+        /// @param path file path to map
+        /// @return mapped file or nullptr when opening or mapping the file fails
+        [[nodiscard]]
+        static std::unique_ptr<MappedFile> try_map(const std::string& path) {
+            std::unique_ptr<MappedFile> file(new MappedFile());
+            if (!file->map(path)) {
+                return nullptr;
+            }
+            return file;
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /// @brief Unmaps the file.
+        ~MappedFile() {  // clang-format off
+            if (_data == nullptr) {
+                return;
+            }
+            #ifdef _WIN32
+                UnmapViewOfFile(_data);
+            #else
+                munmap(const_cast<char*>(_data), _size);
+            #endif
+        }  // clang-format on
+
+        /// @brief Returns file contents.
+        /// @return view into the mapping, valid as long as this object
+        [[nodiscard]]
+        std::string_view contents() const {
+            return { _data, _size };
+        }
+    };
+
+    /// @brief Calls the function with file contents, which are mapped into memory if the file is large enough
+    /// and read into a string otherwise (or when mapping fails).
+    /// @tparam F function type
+    /// @param path file path to read
+    /// @param mapping_threshold minimal file size (in bytes) for memory mapping
+    /// @param function function taking std::string_view with file contents, valid only during the call
+    /// @return value returned by the function
+    /// @throws usos_rpc::Exception when reading the file fails
+    template <typename F>
+    auto with_file_contents(const std::string& path, std::size_t mapping_threshold, F&& function) {
+        // Only non-empty regular files are mapped, everything else is simply read.
+        std::error_code error;
+        auto size = std::filesystem::is_regular_file(path, error) ? std::filesystem::file_size(path, error) : 0;
+        if (!error && size > 0 && size >= mapping_threshold) {
+            // Not every file can be mapped (for example on some network file systems), which is not an error.
+            if (auto mapping = MappedFile::try_map(path)) {
+                return function(mapping->contents());
+            }
+        }
+        auto contents = read_file(path);
+        return function(std::string_view(contents));
+    }
+
     /// @brief Writes file contents.
     /// @tparam T contents' type
     /// @param path file path to write
@@ -3,12 +3,24 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <optional>
-#include <set>
-#include <string>
+#include <ranges>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
+#include "../files.hpp"
 #include "event.hpp"
+#include "event_record.hpp"
+#include "fingerprint.hpp"
+#include "interval_index.hpp"
+#include "time_zone.hpp"
+#include "zone_offsets.hpp"
 
 #include "date/date.h"
 #include "date/tz.h"
@@ -20,86 +32,366 @@ namespace usos_rpc::icalendar {
 
     /// @brief Represents a calendar/timetable containing events, parsed from iCalendar format.
     class Calendar {
+    public:
+        /// @brief Memory owned by a single calendar: decoded iCalendar text and event storage.
+        /// Kept on the heap, so that views into it stay valid when the calendar is moved.
+        struct Arena {
+            /// @brief Memory resource for everything related to the calendar.
+            std::pmr::monotonic_buffer_resource resource;
+            /// @brief Sorted list of unique events, allocated in the arena.
+            std::pmr::vector<EventRecord> records;
+            /// @brief Strings referenced by the event records.
+            Dictionary strings;
+            /// @brief Latest end time of all events up to the same index in the list above,
+            /// which is monotonic, unlike the end times themselves.
+            std::pmr::vector<date::sys_seconds> latest_ends;
+            /// @brief Indices of event records by the text of their VEVENT blocks,
+            /// for reusing them in the next version of the calendar.
+            std::pmr::unordered_map<std::string_view, std::uint32_t, FingerprintHash> cache;
+            /// @brief Mapped snapshot file, if the calendar was loaded from one. Strings of its events point into it.
+            std::unique_ptr<MappedFile> mapping;
+
+            /// @brief Creates an arena with a single initial buffer.
+            /// @param initial_size size of the first buffer, should be enough to fit the whole calendar
+            explicit Arena(std::size_t initial_size = 1024):
+            resource(initial_size),
+            records(&resource),
+            strings(&resource),
+            latest_ends(&resource),
+            cache(&resource) {}
+
+            /// @brief Sorts the events, removes duplicates (keeping the first one of every group of equal events)
+            /// and stores them as records. Identifiers and descriptions are unique, so they are stored as they are
+            /// and have to point into memory of the arena. Other strings repeat a lot, so they are stored once,
+            /// copied into the arena. Can be called only once.
+            /// @param events parsed events in document order
+            void store_events(std::vector<Event>& events) {
+                if (!std::ranges::is_sorted(events)) {
+                    std::ranges::stable_sort(events);
+                }
+                auto duplicates = std::ranges::unique(events, [](const Event& first, const Event& second) {
+                    return (first <=> second) == 0;
+                });
+                events.erase(duplicates.begin(), duplicates.end());
+
+                std::unordered_map<std::string_view, TextId, FingerprintHash> interned;
+                interned.reserve(256);
+                auto intern = [this, &interned](std::optional<std::string_view> text) {
+                    if (!text.has_value()) {
+                        return NO_TEXT;
+                    }
+                    auto [it, inserted] = interned.try_emplace(text.value(), 0);
+                    if (inserted) {
+                        auto* copy = allocate_text(text->size());
+                        std::ranges::copy(text.value(), copy);
+                        it->second = add_text(std::string_view(copy, text->size()));
+                    }
+                    return it->second;
+                };
+                auto add = [this](std::optional<std::string_view> text) {
+                    return text.has_value() ? add_text(text.value()) : NO_TEXT;
+                };
+
+                records.reserve(events.size());
+                strings.reserve(events.size() * 2);
+                cache.reserve(events.size());
+                for (const auto& event : events) {
+                    if (!event.source().empty()) {
+                        cache.emplace(event.source(), static_cast<std::uint32_t>(records.size()));
+                    }
+                    records.push_back({
+                        .start = event.start(),
+                        .end = event.end(),
+                        .utc_start = {},
+                        .utc_end = {},
+                        .uid = add(event.uid()),
+                        .subject = intern(event.subject()),
+                        .type = intern(event.type()),
+                        .description = add(event.description()),
+                        .address = intern(event.address()),
+                    });
+                }
+            }
+
+            /// @brief Adds a string to the dictionary, without copying it.
+            /// @param text string, has to outlive the arena
+            /// @return string identifier
+            TextId add_text(std::string_view text) {
+                strings.push_back(text);
+                return static_cast<TextId>(strings.size() - 1);
+            }
+
+            /// @brief Allocates a buffer for text in the arena.
+            /// @param size buffer size
+            /// @return pointer to the beginning of the buffer
+            [[nodiscard]]
+            char* allocate_text(std::size_t size) {
+                return static_cast<char*>(resource.allocate(size, alignof(char)));
+            }
+        };
+
+    private:
+        /// @brief Memory arena for all strings and events of this calendar.
+        std::unique_ptr<Arena> _arena;
         /// @brief Calendar name.
-        std::string _name;
+        std::string_view _name;
         /// @brief Product identifier of the software that generated this calendar file.
-        std::string _product_id;
+        std::string_view _product_id;
         /// @brief Calendar time zone, applied to all event timestamps.
-        const date::time_zone* _time_zone;
-        /// @brief List of events.
-        std::set<Event> _events;
+        TimeZone _time_zone;
+        /// @brief Fingerprint of the calendar data, without DTSTAMP properties.
+        ContentFingerprint _fingerprint;
+        /// @brief Beginning of the range of time the events were parsed for, events ending earlier were skipped.
+        date::sys_seconds _window_begin = date::sys_seconds::min();
+        /// @brief End of the range of time the events were parsed for, events starting later were skipped.
+        date::sys_seconds _window_end = date::sys_seconds::max();
+        /// @brief Offsets of the calendar time zone, compiled from its VTIMEZONE or taken from the database
+        /// for the time span of all events.
+        ZoneOffsets _offsets;
+        /// @brief Index of event times, for finding overlapping events.
+        IntervalIndex _index;
+        /// @brief Index of the event found by the last call to next_event().
+        std::size_t _cursor = 0;
+        /// @brief Time passed to the last call to next_event().
+        std::chrono::system_clock::time_point _cursor_time;
 
     public:
-        Calendar() = default;  // To simplify Config class.
+        Calendar(): _arena(std::make_unique<Arena>()) {}  // To simplify Config class.
+
+        // Calendars own all their events and strings, so they are only ever moved, never copied.
+        Calendar(const Calendar&) = delete;
+        Calendar(Calendar&&) = default;
+        Calendar& operator=(const Calendar&) = delete;
+        Calendar& operator=(Calendar&&) = default;
 
         /// @brief Constructor based on VCALENDAR format.
-        /// @param events list of events
+        /// @param arena memory arena containing all strings and events of the calendar
+        /// @param fingerprint fingerprint of the calendar data, equal for calendars with the same contents
+        /// @param window_begin beginning of the parsed range of time, sys_seconds::min() if unbounded
+        /// @param window_end end of the parsed range of time, sys_seconds::max() if unbounded
         Calendar(
-            const std::string& calname,
-            const std::string& prodid,
-            const std::string& timezone,
-            const std::set<Event>& events
+            std::unique_ptr<Arena> arena,
+            std::string_view calname,
+            std::string_view prodid,
+            TimeZone tz,
+            ContentFingerprint fingerprint,
+            date::sys_seconds window_begin = date::sys_seconds::min(),
+            date::sys_seconds window_end = date::sys_seconds::max()
         ):
+        _arena(std::move(arena)),
         _name(calname),
         _product_id(prodid),
-        _events(events) {
-            _time_zone = date::locate_zone(timezone);
-        }
-
-        /// @brief Returns an iterator to the current/upcoming event, or nullopt if none were found.
-        /// In order to do that, additionally deletes events from the past from the list of events.
-        /// @return pointer (iterator) to the next event or nullopt
-        std::optional<std::set<Event>::iterator> next_event() {
-            auto now = std::chrono::system_clock::now();
-            auto it = _events.begin();
-            while (it != _events.end()) {
-                if (it->end(_time_zone).get_sys_time() < now) {
-                    it = _events.erase(it);
-                } else {
-                    return it;
+        _time_zone(std::move(tz)),
+        _fingerprint(fingerprint),
+        _window_begin(window_begin),
+        _window_end(window_end) {
+            auto& records = _arena->records;
+            if (_time_zone.offsets() != nullptr) {
+                _offsets = *_time_zone.offsets();
+            } else if (!records.empty()) {
+                // Events are sorted by start, but a long event might end after all others.
+                auto last = std::ranges::max(records, {}, &EventRecord::end).end;
+                _offsets = ZoneOffsets(_time_zone.database_zone(), records.front().start, last);
+            }
+
+            auto& latest_ends = _arena->latest_ends;
+            latest_ends.clear();
+            latest_ends.reserve(records.size());
+            auto latest = date::sys_seconds::min();
+            for (auto& record : records) {
+                record.utc_start = _offsets.to_sys(record.start);
+                record.utc_end = _offsets.to_sys(record.end);
+                latest = std::max(latest, record.utc_end);
+                latest_ends.push_back(latest);
+            }
+            _index = IntervalIndex(records);
+        }
+
+        /// @brief Returns the current or upcoming event, that is the first event (in order of start time)
+        /// which has not ended yet. Uses binary search and does not modify the list of events.
+        /// @param now current time
+        /// @return event or nullopt if all events have already ended
+        [[nodiscard]]
+        std::optional<EventRef> next_event(std::chrono::system_clock::time_point now) {
+            const auto& latest_ends = _arena->latest_ends;
+            // Time usually moves forward, so the search can start from the previous result.
+            auto first = latest_ends.begin() + (now >= _cursor_time ? _cursor : 0);
+            auto found = std::lower_bound(first, latest_ends.end(), now, [](date::sys_seconds end, auto time) {
+                return end < time;
+            });
+            _cursor = static_cast<std::size_t>(found - latest_ends.begin());
+            _cursor_time = now;
+            if (found == latest_ends.end()) {
+                return std::nullopt;
+            }
+            return event(_cursor);
+        }
+
+        /// @brief Finds the first event (in order of start time) which has not ended before the given time.
+        /// Every earlier event has ended, but later ones might have ended as well, if they are shorter.
+        /// @param time point in time
+        /// @return event index or the number of events if all of them have ended
+        [[nodiscard]]
+        std::size_t first_unended(date::sys_seconds time) const {
+            const auto& latest_ends = _arena->latest_ends;
+            auto found = std::ranges::lower_bound(latest_ends, time);
+            return static_cast<std::size_t>(found - latest_ends.begin());
+        }
+
+        /// @brief Returns all events overlapping the given range of time, that is events which start
+        /// no later than its end and end no earlier than its beginning.
+        /// @param from beginning of the range
+        /// @param to end of the range
+        /// @return events in order of start time
+        [[nodiscard]]
+        std::vector<EventRef> events_between(
+            std::chrono::system_clock::time_point from,
+            std::chrono::system_clock::time_point to
+        ) const {
+            std::vector<EventRef> result;
+            // Event times are whole seconds, so rounding the range inwards does not change the result.
+            _index.visit_overlapping(
+                std::chrono::ceil<std::chrono::seconds>(from),
+                std::chrono::floor<std::chrono::seconds>(to),
+                [this, &result](std::size_t index) {
+                    result.push_back(event(index));
                 }
+            );
+            return result;
+        }
+
+        /// @brief Returns all events active at the given time, that is events which have started
+        /// and have not ended yet. There might be more than one, as events can overlap.
+        /// @param time point in time
+        /// @return events in order of start time
+        [[nodiscard]]
+        std::vector<EventRef> events_at(std::chrono::system_clock::time_point time) const {
+            return events_between(time, time);
+        }
+
+        /// @brief Finds an event parsed from exactly the same VEVENT block and recreates it,
+        /// pointing into the given copy of the block.
+        /// @param source decoded text of a VEVENT block, has to outlive the returned event
+        /// @return event or nullopt if the block is not known
+        [[nodiscard]]
+        std::optional<Event> reuse_event(std::string_view source) const {
+            auto it = _arena->cache.find(source);
+            if (it == _arena->cache.end()) {
+                return std::nullopt;
             }
-            return std::nullopt;
+            const auto& record = _arena->records[it->second];
+            const auto& strings = _arena->strings;
+            // Identifiers and descriptions point into the block, other strings are copied by the next calendar anyway.
+            auto relocated = [&strings, &source, old_source = it->first](TextId id) -> std::optional<std::string_view> {
+                if (id == NO_TEXT) {
+                    return std::nullopt;
+                }
+                return std::string_view(source.data() + (strings[id].data() - old_source.data()), strings[id].size());
+            };
+            auto text = [&strings](TextId id) -> std::optional<std::string_view> {
+                if (id == NO_TEXT) {
+                    return std::nullopt;
+                }
+                return strings[id];
+            };
+            return Event(
+                relocated(record.uid).value(),
+                strings[record.subject],
+                text(record.type),
+                relocated(record.description),
+                text(record.address),
+                record.start,
+                record.end,
+                source
+            );
         }
 
         /// @brief Returns the calendar name.
         /// @return calendar name
         [[nodiscard]]
-        const std::string& name() const {
+        std::string_view name() const {
             return _name;
         }
 
         /// @brief Returns the product identifier of the software that generated this calendar file.
         /// @return product identifier
         [[nodiscard]]
-        const std::string& product_id() const {
+        std::string_view product_id() const {
             return _product_id;
         }
 
         /// @brief Returns the calendar time zone.
         /// @return time zone
         [[nodiscard]]
-        const date::time_zone* time_zone() const {
+        const TimeZone& time_zone() const {
             return _time_zone;
         }
 
-        /// @brief Returns the set of events.
-        /// @return list of events
+        /// @brief Returns the fingerprint of the calendar data, which does not depend on DTSTAMP properties.
+        /// @return calendar fingerprint
+        [[nodiscard]]
+        ContentFingerprint fingerprint() const {
+            return _fingerprint;
+        }
+
+        /// @brief Returns the beginning of the range of time the events were parsed for.
+        /// Events which ended earlier are missing from the calendar, even if the file contained them.
+        /// @return beginning of the window or sys_seconds::min() if the calendar is complete
+        [[nodiscard]]
+        date::sys_seconds window_begin() const {
+            return _window_begin;
+        }
+
+        /// @brief Returns the end of the range of time the events were parsed for.
+        /// Events which start later are missing from the calendar, even if the file contained them.
+        /// @return end of the window or sys_seconds::max() if the calendar is complete
+        [[nodiscard]]
+        date::sys_seconds window_end() const {
+            return _window_end;
+        }
+
+        /// @brief Returns a view of a single event.
+        /// @param index event index, in order of events()
+        /// @return event
+        [[nodiscard]]
+        EventRef event(std::size_t index) const {
+            return EventRef(_arena->records[index], _arena->strings);
+        }
+
+        /// @brief Returns all events, sorted by time of start, then end, then unique identifier.
+        /// @return range of events
+        [[nodiscard]]
+        auto events() const {
+            return std::views::transform(_arena->records, [&strings = _arena->strings](const EventRecord& record) {
+                return EventRef(record, strings);
+            });
+        }
+
+        /// @brief Returns raw event records, for serialization.
+        /// @return list of event records
+        [[nodiscard]]
+        const std::pmr::vector<EventRecord>& records() const {
+            return _arena->records;
+        }
+
+        /// @brief Returns the dictionary of strings referenced by event records, for serialization.
+        /// @return dictionary
         [[nodiscard]]
-        const std::set<Event>& events() const {
-            return _events;
+        const Dictionary& strings() const {
+            return _arena->strings;
         }
 
         /// @brief Calendar formatting support for fmt.
         /// @param event event to format
         /// @return formatted string
         friend auto format_as(const Calendar& event) {
+            auto events = event.events();
             return fmt::format(
                 "{}\nProduct ID: {}\nTime zone: {}\nEvents:\n\n{}",
                 fmt::styled(event._name, colors::OTHER),
                 event._product_id,
-                event._time_zone->name(),
-                fmt::join(event._events, "\n")
+                event._time_zone.name(),
+                fmt::join(events, "\n")
             );
         }
     };
@@ -0,0 +1,315 @@
+/// @file
+/// @brief Differences between two versions of a calendar, as a list of changed events.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "calendar.hpp"
+#include "event_record.hpp"
+#include "fingerprint.hpp"
+
+#include "date/date.h"
+#include "fmt/color.h"
+#include "fmt/format.h"
+
+namespace {
+
+    /// @brief Marks the end of a chain of events with the same unique identifier.
+    constexpr std::uint32_t NO_EVENT = std::numeric_limits<std::uint32_t>::max();
+
+    /// @brief Events of a calendar grouped by unique identifier, taken one by one in order of time.
+    class UidChains {
+        /// @brief First untaken event with each identifier.
+        std::unordered_map<std::string_view, std::uint32_t, usos_rpc::icalendar::FingerprintHash> _heads;
+        /// @brief Next event with the same identifier as the event at the same index.
+        std::vector<std::uint32_t> _next;
+
+    public:
+        /// @brief Groups the selected events of a calendar.
+        /// @param calendar calendar to group events of
+        /// @param selected predicate selecting events to group
+        template <typename Predicate>
+        UidChains(const usos_rpc::icalendar::Calendar& calendar, Predicate&& selected):
+        _next(calendar.records().size(), NO_EVENT) {
+            _heads.reserve(calendar.records().size());
+            for (auto index = static_cast<std::uint32_t>(calendar.records().size()); index-- > 0;) {
+                auto event = calendar.event(index);
+                if (!selected(event)) {
+                    continue;
+                }
+                auto [head, inserted] = _heads.try_emplace(event.uid(), index);
+                if (!inserted) {
+                    _next[index] = head->second;
+                    head->second = index;
+                }
+            }
+        }
+
+        /// @brief Takes the earliest untaken event with the given identifier.
+        /// @param uid unique identifier
+        /// @return event index or NO_EVENT if there is none left
+        std::uint32_t take(std::string_view uid) {
+            auto head = _heads.find(uid);
+            if (head == _heads.end() || head->second == NO_EVENT) {
+                return NO_EVENT;
+            }
+            auto index = head->second;
+            head->second = _next[index];
+            return index;
+        }
+    };
+
+    /// @brief Checks whether two versions of an event take place in the same location.
+    /// Raw descriptions are compared first, so that they are decoded only when they differ.
+    /// @param before previous version of the event
+    /// @param after current version of the event
+    /// @return result of the check
+    [[nodiscard]]
+    bool same_location(const usos_rpc::icalendar::EventRef& before, const usos_rpc::icalendar::EventRef& after) {
+        if (before.address() != after.address()) {
+            return false;
+        }
+        if (before.description() == after.description()) {
+            return true;
+        }
+        // The description also contains the URL of the event, which does not matter here.
+        return before.room() == after.room() && before.building() == after.building();
+    }
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Copy of a single version of a changed event, valid after its calendar has been released.
+    struct EventVersion {
+        /// @brief University subject.
+        std::string subject;
+        /// @brief Date and time of the beginning of the event, in the calendar time zone.
+        date::local_seconds start;
+        /// @brief Date and time of the end of the event, in the calendar time zone.
+        date::local_seconds end;
+        /// @brief Beginning of the event in UTC.
+        date::sys_seconds utc_start;
+        /// @brief End of the event in UTC.
+        date::sys_seconds utc_end;
+        /// @brief Location in a readable form, empty if the event has no location.
+        std::string location;
+
+        /// @brief Copies the event data.
+        /// @param event event to copy
+        explicit EventVersion(const EventRef& event):
+        subject(event.subject()),
+        start(event.start()),
+        end(event.end()),
+        utc_start(event.utc_start()),
+        utc_end(event.utc_end()),
+        location(event.location()) {}
+
+        /// @brief Checks whether the event overlaps the given range of time.
+        /// @param from beginning of the range
+        /// @param to end of the range
+        /// @return true if the event has not ended before the range and has not started after it
+        [[nodiscard]]
+        bool overlaps(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) const {
+            return utc_end >= from && utc_start <= to;
+        }
+    };
+
+    /// @brief Type of change of a single event.
+    enum class ChangeType {
+        /// @brief Event has been added to the calendar.
+        ADDED,
+        /// @brief Event has been removed from the calendar.
+        REMOVED,
+        /// @brief Event has been moved to another time.
+        RESCHEDULED,
+        /// @brief Event has been moved to another room, building or address.
+        RELOCATED,
+    };
+
+    /// @brief Change of a single event between two versions of a calendar.
+    /// An event which has been both rescheduled and relocated is reported as two changes.
+    struct EventChange {
+        /// @brief Type of change.
+        ChangeType type;
+        /// @brief Event before the change, nullopt for added events.
+        std::optional<EventVersion> before;
+        /// @brief Event after the change, nullopt for removed events.
+        std::optional<EventVersion> after;
+
+        /// @brief Checks whether either version of the event overlaps the given range of time.
+        /// @param from beginning of the range
+        /// @param to end of the range
+        /// @return result of the check
+        [[nodiscard]]
+        bool overlaps(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) const {
+            return (before.has_value() && before->overlaps(from, to))
+                   || (after.has_value() && after->overlaps(from, to));
+        }
+
+        /// @brief Change formatting support for fmt.
+        /// @param change change to format
+        /// @return formatted string
+        friend auto format_as(const EventChange& change) {
+            auto time = [](const EventVersion& event) {
+                auto start = date::format("%Y-%m-%d %H:%M", event.start);
+                return fmt::format("{} - {}", start, date::format("%H:%M", event.end));
+            };
+            const auto& event = change.after.has_value() ? *change.after : *change.before;
+            auto subject = fmt::styled(event.subject, colors::OTHER);
+            switch (change.type) {
+                case ChangeType::ADDED:
+                    return fmt::format("Added: {} ({})\n", subject, time(event));
+                case ChangeType::REMOVED:
+                    return fmt::format("Removed: {} ({})\n", subject, time(event));
+                case ChangeType::RESCHEDULED:
+                    return fmt::format("Rescheduled: {} ({} -> {})\n", subject, time(*change.before), time(event));
+                case ChangeType::RELOCATED:
+                    return fmt::format("Relocated: {} ({} -> {})\n", subject, change.before->location, event.location);
+            }
+            return std::string();
+        }
+    };
+
+    /// @brief Changed events between two versions of a calendar.
+    struct CalendarDiff {
+        /// @brief Changes of added, rescheduled and relocated events in order of time of start,
+        /// followed by changes of removed events.
+        std::vector<EventChange> changes;
+
+        /// @brief Checks whether any event has changed.
+        /// @return true if nothing has changed
+        [[nodiscard]]
+        bool empty() const {
+            return changes.empty();
+        }
+
+        /// @brief Counts changes of the given type.
+        /// @param type type of change
+        /// @return number of changes
+        [[nodiscard]]
+        std::size_t count(ChangeType type) const {
+            return static_cast<std::size_t>(std::ranges::count(changes, type, &EventChange::type));
+        }
+
+        /// @brief Checks whether any change concerns the given range of time, e.g. current and upcoming events.
+        /// @param from beginning of the range
+        /// @param to end of the range
+        /// @return result of the check
+        [[nodiscard]]
+        bool affects(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) const {
+            return std::ranges::any_of(changes, [from, to](const EventChange& change) {
+                return change.overlaps(from, to);
+            });
+        }
+    };
+
+    /// @brief Finds changed events between two versions of a calendar, matching events by unique identifier
+    /// with a single hash join. Events sharing an identifier (e.g. occurrences of a recurring event)
+    /// are matched in order of time.
+    ///
+    /// Calendars parsed with an event window only contain part of the file, and the window moves every day.
+    /// Only events overlapping both windows are compared, so that events entering or leaving the window
+    /// are not reported as added or removed. Such events are still matched with events inside the overlap,
+    /// e.g. to report an event rescheduled to the next week.
+    /// @param previous previous version of the calendar
+    /// @param current current version of the calendar
+    /// @return changed events
+    [[nodiscard]]
+    CalendarDiff diff_calendars(const Calendar& previous, const Calendar& current) {
+        auto from = std::max(previous.window_begin(), current.window_begin());
+        auto to = std::min(previous.window_end(), current.window_end());
+        auto in_overlap = [from, to](const EventRef& event) {
+            return event.utc_end() >= from && event.utc_start() <= to;
+        };
+        auto outside_overlap = [&in_overlap](const EventRef& event) {
+            return !in_overlap(event);
+        };
+
+        CalendarDiff diff;
+        // Adds changes between two versions of the same event.
+        auto compare_versions = [&diff](const EventRef& before, const EventRef& after) {
+            if (before.utc_start() != after.utc_start() || before.utc_end() != after.utc_end()) {
+                diff.changes.push_back({
+                    .type = ChangeType::RESCHEDULED,
+                    .before = EventVersion(before),
+                    .after = EventVersion(after),
+                });
+            }
+            if (!same_location(before, after)) {
+                diff.changes.push_back({
+                    .type = ChangeType::RELOCATED,
+                    .before = EventVersion(before),
+                    .after = EventVersion(after),
+                });
+            }
+        };
+
+        UidChains previous_inside(previous, in_overlap);
+        std::vector<bool> matched(previous.records().size(), false);
+        std::vector<EventRef> unmatched;
+        for (const auto& event : current.events()) {
+            if (!in_overlap(event)) {
+                continue;
+            }
+            auto index = previous_inside.take(event.uid());
+            if (index == NO_EVENT) {
+                unmatched.push_back(event);
+                continue;
+            }
+            matched[index] = true;
+            compare_versions(previous.event(index), event);
+        }
+
+        // Events without a match inside the overlap might have been moved across its boundary.
+        UidChains previous_outside(previous, outside_overlap);
+        for (const auto& event : unmatched) {
+            auto index = previous_outside.take(event.uid());
+            if (index != NO_EVENT) {
+                compare_versions(previous.event(index), event);
+                continue;
+            }
+            diff.changes.push_back({
+                .type = ChangeType::ADDED,
+                .before = std::nullopt,
+                .after = EventVersion(event),
+            });
+        }
+        UidChains current_outside(current, outside_overlap);
+        std::vector<EventChange> removed;
+        for (std::uint32_t index = 0; index < previous.records().size(); index++) {
+            auto before = previous.event(index);
+            if (matched[index] || !in_overlap(before)) {
+                continue;
+            }
+            auto after = current_outside.take(before.uid());
+            if (after != NO_EVENT) {
+                compare_versions(before, current.event(after));
+                continue;
+            }
+            removed.push_back({
+                .type = ChangeType::REMOVED,
+                .before = EventVersion(before),
+                .after = std::nullopt,
+            });
+        }
+
+        std::ranges::stable_sort(diff.changes, {}, [](const EventChange& change) {
+            return change.after->start;
+        });
+        std::ranges::move(removed, std::back_inserter(diff.changes));
+        return diff;
+    }
+
+}
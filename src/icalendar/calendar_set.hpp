@@ -0,0 +1,248 @@
+/// @file
+/// @brief Calendars from several sources, merged into a single list of events.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "calendar.hpp"
+#include "event_record.hpp"
+#include "fingerprint.hpp"
+
+#include "date/date.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Calendars from several sources, seen as a single list of events. Every source keeps its own calendar,
+    /// so refreshing one source rebuilds only its events. Events are merged lazily in order of time of start,
+    /// and an event is skipped when an earlier source has an event with the same unique identifier.
+    class CalendarSet {
+        /// @brief Calendars in order of sources.
+        std::vector<Calendar> _calendars;
+        /// @brief Unique identifiers of the events of every source, except the last one.
+        std::vector<std::unordered_set<std::string_view, FingerprintHash>> _uids;
+
+        /// @brief Rebuilds the unique identifiers of a single source, after its calendar has changed.
+        /// Identifiers of the last source are never looked up, so they are not stored at all.
+        /// @param source index of the source
+        void index_uids(std::size_t source) {
+            if (source + 1 >= _calendars.size()) {
+                return;
+            }
+            auto& uids = _uids[source];
+            uids.clear();
+            uids.reserve(_calendars[source].records().size());
+            for (const auto& event : _calendars[source].events()) {
+                uids.insert(event.uid());
+            }
+        }
+
+        /// @brief Checks whether an event is not a duplicate of an event from an earlier source.
+        /// @param source source of the event
+        /// @param event event to check
+        /// @return true if the event should be shown
+        [[nodiscard]]
+        bool is_visible(std::size_t source, const EventRef& event) const {
+            return std::ranges::none_of(std::span(_uids).first(source), [&event](const auto& uids) {
+                return uids.contains(event.uid());
+            });
+        }
+
+    public:
+        /// @brief Lazy k-way merge of the events of all sources overlapping a range of time, in order of time
+        /// of start. Events starting at the same time are ordered by source.
+        class MergeIterator {
+            /// @brief Next event of a single source.
+            struct Head {
+                /// @brief Time of start of the event.
+                date::sys_seconds start;
+                /// @brief Source of the event.
+                std::size_t source;
+                /// @brief Index of the event in the calendar of the source.
+                std::size_t index;
+
+                /// @brief Orders heads so that the heap keeps the earliest one at the front.
+                /// @param other head to compare
+                /// @return true if this head comes after the other one
+                bool operator>(const Head& other) const {
+                    return std::pair(start, source) > std::pair(other.start, other.source);
+                }
+            };
+
+            /// @brief Merged calendars.
+            const CalendarSet* _set = nullptr;
+            /// @brief Beginning of the range of time, events ending earlier are skipped.
+            date::sys_seconds _from;
+            /// @brief End of the range of time, events starting later are skipped.
+            date::sys_seconds _to;
+            /// @brief Next events of all sources which have any left, a heap with the earliest one at the front.
+            std::vector<Head> _heads;
+
+            /// @brief Finds the next event of a source overlapping the range of time and adds it to the heap.
+            /// Events are sorted by start, so the first one starting after the range ends the source.
+            /// @param source index of the source
+            /// @param index index of the first event to check
+            void push_head(std::size_t source, std::size_t index) {
+                const auto& records = _set->_calendars[source].records();
+                while (index < records.size() && records[index].utc_start <= _to && records[index].utc_end < _from) {
+                    index++;
+                }
+                if (index < records.size() && records[index].utc_start <= _to) {
+                    _heads.push_back({ .start = records[index].utc_start, .source = source, .index = index });
+                    std::ranges::push_heap(_heads, std::greater<>());
+                }
+            }
+
+            /// @brief Moves to the next event, which might be a duplicate.
+            void advance() {
+                std::ranges::pop_heap(_heads, std::greater<>());
+                auto head = _heads.back();
+                _heads.pop_back();
+                push_head(head.source, head.index + 1);
+            }
+
+            /// @brief Skips duplicates of events from earlier sources.
+            void skip_duplicates() {
+                while (!_heads.empty() && !_set->is_visible(_heads.front().source, **this)) {
+                    advance();
+                }
+            }
+
+        public:
+            using value_type = EventRef;
+            using difference_type = std::ptrdiff_t;
+
+            MergeIterator() = default;
+
+            /// @brief Creates an iterator at the first event overlapping the given range of time.
+            /// @param set merged calendars
+            /// @param from beginning of the range
+            /// @param to end of the range
+            MergeIterator(const CalendarSet& set, date::sys_seconds from, date::sys_seconds to):
+            _set(&set),
+            _from(from),
+            _to(to) {
+                _heads.reserve(set._calendars.size());
+                for (std::size_t source = 0; source < set._calendars.size(); source++) {
+                    // Every event before the first one which has not ended yet has ended as well.
+                    push_head(source, set._calendars[source].first_unended(from));
+                }
+                skip_duplicates();
+            }
+
+            /// @brief Returns the current event.
+            /// @return event
+            EventRef operator*() const {
+                const auto& head = _heads.front();
+                return _set->_calendars[head.source].event(head.index);
+            }
+
+            /// @brief Moves to the next event which is not a duplicate.
+            /// @return this iterator
+            MergeIterator& operator++() {
+                advance();
+                skip_duplicates();
+                return *this;
+            }
+
+            /// @brief Moves to the next event which is not a duplicate.
+            void operator++(int) {
+                ++*this;
+            }
+
+            /// @brief Checks whether all events have been visited.
+            /// @return true at the end
+            bool operator==(std::default_sentinel_t) const {
+                return _heads.empty();
+            }
+        };
+
+        CalendarSet() = default;
+
+        /// @brief Creates a set of empty calendars.
+        /// @param sources number of sources
+        explicit CalendarSet(std::size_t sources): _calendars(sources), _uids(sources) {}
+
+        /// @brief Replaces the calendar of a single source.
+        /// @param source index of the source
+        /// @param calendar new calendar
+        void replace(std::size_t source, Calendar&& calendar) {
+            _calendars[source] = std::move(calendar);
+            index_uids(source);
+        }
+
+        /// @brief Returns the calendar of a single source.
+        /// @param source index of the source
+        /// @return calendar
+        [[nodiscard]]
+        const Calendar& operator[](std::size_t source) const {
+            return _calendars[source];
+        }
+
+        /// @brief Returns the number of sources.
+        /// @return number of sources
+        [[nodiscard]]
+        std::size_t size() const {
+            return _calendars.size();
+        }
+
+        /// @brief Returns the current or upcoming event of all sources, that is the first event
+        /// (in order of start time) which has not ended yet.
+        /// @param now current time
+        /// @return event or nullopt if all events have already ended
+        [[nodiscard]]
+        std::optional<EventRef> next_event(std::chrono::system_clock::time_point now) const {
+            MergeIterator merged(*this, std::chrono::ceil<std::chrono::seconds>(now), date::sys_seconds::max());
+            if (merged == std::default_sentinel) {
+                return std::nullopt;
+            }
+            return *merged;
+        }
+
+        /// @brief Returns events of all sources overlapping the given range of time.
+        /// @param from beginning of the range
+        /// @param to end of the range
+        /// @return events in order of start time
+        [[nodiscard]]
+        std::vector<EventRef> events_between(
+            std::chrono::system_clock::time_point from,
+            std::chrono::system_clock::time_point to
+        ) const {
+            std::vector<EventRef> result;
+            // Event times are whole seconds, so rounding the range inwards does not change the result.
+            auto from_seconds = std::chrono::ceil<std::chrono::seconds>(from);
+            auto to_seconds = std::chrono::floor<std::chrono::seconds>(to);
+            for (MergeIterator merged(*this, from_seconds, to_seconds); merged != std::default_sentinel; ++merged) {
+                result.push_back(*merged);
+            }
+            return result;
+        }
+
+        /// @brief Returns events of all sources active at the given time.
+        /// @param time point in time
+        /// @return events in order of start time
+        [[nodiscard]]
+        std::vector<EventRef> events_at(std::chrono::system_clock::time_point time) const {
+            return events_between(time, time);
+        }
+
+        /// @brief Returns all events of all sources without duplicates, merged lazily.
+        /// @return range of events in order of start time
+        [[nodiscard]]
+        std::ranges::subrange<MergeIterator, std::default_sentinel_t> events() const {
+            return { MergeIterator(*this, date::sys_seconds::min(), date::sys_seconds::max()), std::default_sentinel };
+        }
+    };
+
+}
@@ -3,180 +3,191 @@
 
 #pragma once
 
+#include <array>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
-#include <variant>
 
 #include "../exceptions.hpp"
 #include "utilities.hpp"
 
 #include "date/date.h"
 #include "date/tz.h"
-#include "fmt/color.h"
-#include "fmt/format.h"
 
 namespace usos_rpc::icalendar {
 
-    /// @brief Represents a single event in the timetable, for example a lecture or a class.
+    /// @brief Event details which USOS puts in the description of events with a known location.
+    struct EventDetails {
+        std::string_view room;
+        std::string_view building;
+        std::string_view url;
+    };
+
+    /// @brief Decodes event details from a description, which should consist of exactly 3 non-blank lines:
+    /// room (optionally prefixed with a label), building and URL.
+    /// @param description event description
+    /// @return decoded details or nullopt if the description has a different format
+    [[nodiscard]]
+    std::optional<EventDetails> decode_description(std::string_view description) {
+        std::array<std::string_view, 3> description_parts;
+        std::size_t part_count = 0;
+        for (auto part : split(description, "\n")) {
+            if (strip(part).empty()) {
+                continue;
+            }
+            if (part_count < description_parts.size()) {
+                description_parts[part_count] = part;
+            }
+            part_count++;
+        }
+        if (part_count != description_parts.size()) {
+            return std::nullopt;
+        }
+
+        auto room = description_parts[0];
+        auto room_separator = room.find(": ");
+        if (room_separator != std::string_view::npos && room.find(": ", room_separator + 2) == std::string_view::npos) {
+            room = room.substr(room_separator + 2);
+        }
+        return EventDetails { .room = room, .building = description_parts[1], .url = description_parts[2] };
+    }
+
+    /// @brief Represents a single event in the timetable, for example a lecture or a class, as parsed
+    /// from a VEVENT block. Calendars store events as compact records, this class is used until then.
+    /// All text fields are views into memory owned by someone else, usually a calendar arena.
+    /// The description is kept as it is and decoded only when its details are needed.
     class Event {
         /// @brief Unique identifier of the event.
-        std::string _uid;
+        std::string_view _uid;
         /// @brief University subject.
-        std::string _subject;
+        std::string_view _subject;
         /// @brief Event type abbreviation, meaning for example a lecture or lab classes.
-        std::optional<std::string> _type;
-        /// @brief URL pointing at the event in the web version of USOS.
-        std::optional<std::string> _url;
-
-        /// @brief Full event location structure.
-        struct FullLocation {
-            std::string room;
-            std::string building;
-            std::string address;
-        };
-
-        using Location = std::variant<std::monostate, std::string, FullLocation>;
-        /// @brief Event location. Can be one of three variants:
-        /// std::monostate - no location was found,
-        /// std::string - only the address was parsed successfully,
-        /// usos_rpc::Event::FullLocation - location was fully parsed.
-        Location _location;
+        std::optional<std::string_view> _type;
+        /// @brief Raw description with event details, kept only for events with a location.
+        std::optional<std::string_view> _description;
+        /// @brief Event address.
+        std::optional<std::string_view> _location;
 
         /// @brief Date and time of the beginning of the event.
         date::local_seconds _start;
         /// @brief Date and time of the end of the event.
         date::local_seconds _end;
 
+        /// @brief Decoded VEVENT block the event was parsed from, empty if unknown.
+        std::string_view _source;
+
     public:
         Event() = delete;
 
-        /// @brief Constructor based on VEVENT format.
+        /// @brief Constructor based on VEVENT format. Does not copy any of the given strings,
+        /// so they have to outlive the event.
         /// @param summary contains subject and type
-        /// @param dtstart start of the event
-        /// @param dtend end of the event
+        /// @param start start of the event in the calendar time zone
+        /// @param end end of the event in the calendar time zone
         /// @param uid identifier
         /// @param description contains partial location and URL
         /// @param location optional address
-        /// @throws usos_rpc::Exception when timestamp parsing fails
+        /// @param source whole VEVENT block containing all of the above
         Event(
-            const std::string& summary,
-            const std::string& dtstart,
-            const std::string& dtend,
-            const std::string& uid,
-            const std::string& description,
-            const std::optional<std::string>& location
+            std::string_view summary,
+            date::local_seconds start,
+            date::local_seconds end,
+            std::string_view uid,
+            std::string_view description,
+            std::optional<std::string_view> location,
+            std::string_view source
         ):
-        _uid(uid) {
-            auto summary_parts = split(summary, " - ");
-            switch (summary_parts.size()) {
-                case 2:
-                    _subject = summary_parts[1];
-                    _type = summary_parts[0];
-                    break;
-                case 1:
-                    _subject = summary_parts[0];
-                    break;
-                default:
-                    _subject = summary;
-                    break;
-            }
-
-            try {
-                std::istringstream start_stream(dtstart);
-                start_stream.exceptions(std::ios_base::badbit);
-                start_stream >> date::parse("%Y%m%dT%H%M%S", _start);
-                std::istringstream end_stream(dtend);
-                end_stream.exceptions(std::ios_base::badbit);
-                end_stream >> date::parse("%Y%m%dT%H%M%S", _end);
-            } catch (const std::ios_base::failure& err) {
-                throw Exception(ExceptionType::ICALENDAR, "Could not parse event timestamp!");
-            }
-
-            if (!location.has_value()) {
-                return;
+        _uid(uid),
+        _location(location),
+        _start(start),
+        _end(end),
+        _source(source) {
+            // Summary is either "type - subject" or just "subject".
+            auto summary_separator = summary.find(" - ");
+            if (summary_separator != std::string_view::npos
+                && summary.find(" - ", summary_separator + 3) == std::string_view::npos) {
+                _subject = summary.substr(summary_separator + 3);
+                _type = summary.substr(0, summary_separator);
+            } else {
+                _subject = summary;
             }
 
-            auto description_parts = split(description, "\n");
-            std::erase_if(description_parts, [](const auto& value) {
-                return strip(value) == "";
-            });
-            if (description_parts.size() == 3) {
-                auto room_split = split(description_parts[0], ": ");
-                auto room = room_split.size() == 2 ? room_split[1] : description_parts[0];
-                _location =
-                    FullLocation { .room = room, .building = description_parts[1], .address = location.value() };
-                _url = description_parts[2];
-            } else {
-                _location = std::string(location.value());
+            // Details from the description are meaningless without the address.
+            if (location.has_value()) {
+                _description = description;
             }
         }
 
+        /// @brief Constructor from already split fields, for example from a stored event.
+        /// Does not copy any of the given strings, so they have to outlive the event.
+        /// @param uid identifier
+        /// @param subject university subject
+        /// @param type optional event type
+        /// @param description optional description with event details, used only together with the address
+        /// @param location optional address
+        /// @param start start of the event in the calendar time zone
+        /// @param end end of the event in the calendar time zone
+        /// @param source VEVENT block the event was parsed from, if known
+        Event(
+            std::string_view uid,
+            std::string_view subject,
+            std::optional<std::string_view> type,
+            std::optional<std::string_view> description,
+            std::optional<std::string_view> location,
+            date::local_seconds start,
+            date::local_seconds end,
+            std::string_view source = {}
+        ):
+        _uid(uid),
+        _subject(subject),
+        _type(type),
+        _description(location.has_value() ? description : std::nullopt),
+        _location(location),
+        _start(start),
+        _end(end),
+        _source(source) {}
+
         /// @brief Returns unique identifier of the event.
         /// @return event unique identifier
         [[nodiscard]]
-        const std::string& uid() const {
+        std::string_view uid() const {
             return _uid;
         }
 
         /// @brief Returns university subject.
         /// @return event subject
         [[nodiscard]]
-        const std::string& subject() const {
+        std::string_view subject() const {
             return _subject;
         }
 
         /// @brief Returns event type abbreviation.
         /// @return event type
         [[nodiscard]]
-        const std::optional<std::string>& type() const {
+        std::optional<std::string_view> type() const {
             return _type;
         }
 
-        /// @brief Returns URL pointing at the event in the Web version of USOS.
-        /// @return event URL
+        /// @brief Returns raw description with event details, present only if the event has an address.
+        /// @return event description or nullopt
         [[nodiscard]]
-        const std::optional<std::string>& url() const {
-            return _url;
+        std::optional<std::string_view> description() const {
+            return _description;
         }
 
-        /// @brief Returns address if the event has one.
-        /// @return event address or nullptr
-        [[nodiscard]]
-        const std::string* address() const {
-            if (std::holds_alternative<std::string>(_location)) {
-                return &std::get<std::string>(_location);
-            } else if (std::holds_alternative<FullLocation>(_location)) {
-                return &std::get<FullLocation>(_location).address;
-            }
-            return nullptr;
-        }
-
-        /// @brief Returns room if the event has one.
-        /// @return event room or nullptr
+        /// @brief Returns decoded text of the VEVENT block the event was parsed from.
+        /// @return event source
         [[nodiscard]]
-        const std::string* room() const {
-            if (std::holds_alternative<FullLocation>(_location)) {
-                return &std::get<FullLocation>(_location).room;
-            }
-            return nullptr;
+        std::string_view source() const {
+            return _source;
         }
 
-        /// @brief Returns building if the event has one.
-        /// @return event building or nullptr
-        [[nodiscard]]
-        const std::string* building() const {
-            if (std::holds_alternative<FullLocation>(_location)) {
-                return &std::get<FullLocation>(_location).building;
-            }
-            return nullptr;
-        }
-
-        /// @brief Checks whether the event has full location information (i.e. building, room and address data).
-        /// @return result of the check
+        /// @brief Returns address if the event has one.
+        /// @return event address or nullopt
         [[nodiscard]]
-        bool has_full_location() const {
-            return std::holds_alternative<FullLocation>(_location);
+        std::optional<std::string_view> address() const {
+            return _location;
         }
 
         /// @brief Returns date and time of the beginning of the event.
@@ -193,20 +204,6 @@ namespace usos_rpc::icalendar {
             return _end;
         }
 
-        /// @brief Returns date and time of the beginning of the event as a zoned time.
-        /// @return zoned start of the event
-        [[nodiscard]]
-        const date::zoned_seconds start(const date::time_zone* tz) const {
-            return date::zoned_seconds(tz, _start);
-        }
-
-        /// @brief Returns date and time of the end of the event as a zoned time.
-        /// @return zoned end of the event
-        [[nodiscard]]
-        const date::zoned_seconds end(const date::time_zone* tz) const {
-            return date::zoned_seconds(tz, _end);
-        }
-
         /// @brief Compares by unique identifier.
         /// @param other event to compare
         /// @return true if equal
@@ -220,35 +217,6 @@ namespace usos_rpc::icalendar {
         auto operator<=>(const Event& other) const {
             return std::tie(_start, _end, _uid) <=> std::tie(other._start, other._end, other._uid);
         }
-
-        /// @brief Event formatting support for fmt.
-        /// @param event event to format
-        /// @return formatted string
-        friend auto format_as(const Event& event) {
-            auto start = date::format("%Y-%m-%d %H:%M", event._start);
-            auto end = date::format("%H:%M", event._end);
-
-            std::string location;
-            if (event.has_full_location()) {
-                location = fmt::format(
-                    "{} - {}, {}",
-                    std::get<Event::FullLocation>(event._location).room,
-                    std::get<Event::FullLocation>(event._location).building,
-                    std::get<Event::FullLocation>(event._location).address
-                );
-            } else if (std::holds_alternative<std::string>(event._location)) {
-                location = std::get<std::string>(event._location);
-            }
-
-            return fmt::format(
-                "{} - {} ({} - {}):\n{}\n",
-                fmt::styled(event._subject, colors::OTHER),
-                event._type.value_or("???"),
-                start,
-                end,
-                location
-            );
-        }
     };
 
 }
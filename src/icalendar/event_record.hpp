@@ -0,0 +1,233 @@
+/// @file
+/// @brief Compact storage of events in a calendar, with text fields encoded as dictionary identifiers.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "event.hpp"
+#include "utilities.hpp"
+
+#include "date/date.h"
+#include "fmt/color.h"
+#include "fmt/format.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Index of a string in the dictionary of a calendar.
+    using TextId = std::uint32_t;
+
+    /// @brief Identifier of a missing optional string.
+    constexpr TextId NO_TEXT = std::numeric_limits<TextId>::max();
+
+    /// @brief Strings of a calendar by their identifiers.
+    using Dictionary = std::pmr::vector<std::string_view>;
+
+    /// @brief Fixed-size event record. Text fields are identifiers of strings in the dictionary of the calendar,
+    /// so strings repeated in many events, like subjects and buildings, are stored only once.
+    struct EventRecord {
+        /// @brief Date and time of the beginning of the event, in the calendar time zone.
+        date::local_seconds start;
+        /// @brief Date and time of the end of the event, in the calendar time zone.
+        date::local_seconds end;
+        /// @brief Beginning of the event in UTC, computed by the calendar.
+        date::sys_seconds utc_start;
+        /// @brief End of the event in UTC, computed by the calendar.
+        date::sys_seconds utc_end;
+        /// @brief Unique identifier of the event.
+        TextId uid;
+        /// @brief University subject.
+        TextId subject;
+        /// @brief Event type abbreviation, NO_TEXT if unknown.
+        TextId type;
+        /// @brief Raw description with room, building and URL, NO_TEXT if there is no address.
+        TextId description;
+        /// @brief Address, NO_TEXT if there is no location.
+        TextId address;
+    };
+
+    static_assert(std::is_trivially_copyable_v<EventRecord> && sizeof(EventRecord) == 56);
+
+    /// @brief Read-only view of an event stored in a calendar. Cheap to copy, valid as long as the calendar.
+    /// The description is decoded on first access to room, building or URL, and the result is kept in the view.
+    class EventRef {
+        /// @brief Event record.
+        const EventRecord* _record;
+        /// @brief Dictionary of the calendar.
+        const Dictionary* _strings;
+        /// @brief Decoded description, empty until needed.
+        mutable std::optional<std::optional<EventDetails>> _details;
+
+        /// @brief Decodes the description once.
+        /// @return event details or nullopt if the event has no full location
+        [[nodiscard]]
+        const std::optional<EventDetails>& details() const {
+            if (!_details.has_value()) {
+                _details = text(_record->description).and_then(decode_description);
+            }
+            return _details.value();
+        }
+
+        /// @brief Returns a string from the dictionary.
+        /// @param id string identifier
+        /// @return string or nullopt for NO_TEXT
+        [[nodiscard]]
+        std::optional<std::string_view> text(TextId id) const {
+            if (id == NO_TEXT) {
+                return std::nullopt;
+            }
+            return (*_strings)[id];
+        }
+
+    public:
+        /// @brief Creates a view of the record.
+        /// @param record event record
+        /// @param strings dictionary of the calendar containing the record
+        EventRef(const EventRecord& record, const Dictionary& strings): _record(&record), _strings(&strings) {}
+
+        /// @brief Returns unique identifier of the event.
+        /// @return event unique identifier
+        [[nodiscard]]
+        std::string_view uid() const {
+            return (*_strings)[_record->uid];
+        }
+
+        /// @brief Returns university subject.
+        /// @return event subject
+        [[nodiscard]]
+        std::string_view subject() const {
+            return (*_strings)[_record->subject];
+        }
+
+        /// @brief Returns event type abbreviation.
+        /// @return event type
+        [[nodiscard]]
+        std::optional<std::string_view> type() const {
+            return text(_record->type);
+        }
+
+        /// @brief Returns URL pointing at the event in the Web version of USOS.
+        /// @return event URL
+        [[nodiscard]]
+        std::optional<std::string_view> url() const {
+            return details().transform([](const EventDetails& details) {
+                return details.url;
+            });
+        }
+
+        /// @brief Returns the raw description with room, building and URL, if the event has an address.
+        /// @return raw description or nullopt
+        [[nodiscard]]
+        std::optional<std::string_view> description() const {
+            return text(_record->description);
+        }
+
+        /// @brief Returns address if the event has one.
+        /// @return event address or nullopt
+        [[nodiscard]]
+        std::optional<std::string_view> address() const {
+            return text(_record->address);
+        }
+
+        /// @brief Returns room if the event has one.
+        /// @return event room or nullopt
+        [[nodiscard]]
+        std::optional<std::string_view> room() const {
+            return details().transform([](const EventDetails& details) {
+                return details.room;
+            });
+        }
+
+        /// @brief Returns building if the event has one.
+        /// @return event building or nullopt
+        [[nodiscard]]
+        std::optional<std::string_view> building() const {
+            return details().transform([](const EventDetails& details) {
+                return details.building;
+            });
+        }
+
+        /// @brief Checks whether the event has full location information (i.e. building, room and address data).
+        /// @return result of the check
+        [[nodiscard]]
+        bool has_full_location() const {
+            return details().has_value();
+        }
+
+        /// @brief Returns the location of the event in a readable form.
+        /// @return room, building and address, only the address, or an empty string if the event has no location
+        [[nodiscard]]
+        std::string location() const {
+            if (has_full_location()) {
+                return fmt::format("{} - {}, {}", *room(), *building(), *address());
+            }
+            return std::string(address().value_or(""));
+        }
+
+        /// @brief Returns date and time of the beginning of the event.
+        /// @return start of the event
+        [[nodiscard]]
+        const date::local_seconds& start() const {
+            return _record->start;
+        }
+
+        /// @brief Returns date and time of the end of the event.
+        /// @return end of the event
+        [[nodiscard]]
+        const date::local_seconds& end() const {
+            return _record->end;
+        }
+
+        /// @brief Returns the beginning of the event in UTC.
+        /// @return UTC start of the event
+        [[nodiscard]]
+        const date::sys_seconds& utc_start() const {
+            return _record->utc_start;
+        }
+
+        /// @brief Returns the end of the event in UTC.
+        /// @return UTC end of the event
+        [[nodiscard]]
+        const date::sys_seconds& utc_end() const {
+            return _record->utc_end;
+        }
+
+        /// @brief Returns the underlying record.
+        /// @return event record
+        [[nodiscard]]
+        const EventRecord& record() const {
+            return *_record;
+        }
+
+        /// @brief Checks whether both views refer to the same stored event.
+        /// @param other view to compare
+        /// @return true if equal
+        bool operator==(const EventRef& other) const {
+            return _record == other._record;
+        }
+
+        /// @brief Event formatting support for fmt.
+        /// @param event event to format
+        /// @return formatted string
+        friend auto format_as(const EventRef& event) {
+            auto start = date::format("%Y-%m-%d %H:%M", event.start());
+            auto end = date::format("%H:%M", event.end());
+            return fmt::format(
+                "{} - {} ({} - {}):\n{}\n",
+                fmt::styled(event.subject(), colors::OTHER),
+                event.type().value_or("???"),
+                start,
+                end,
+                event.location()
+            );
+        }
+    };
+
+}
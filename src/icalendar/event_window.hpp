@@ -0,0 +1,46 @@
+/// @file
+/// @brief Range of time of the events to keep while parsing a calendar.
+
+#pragma once
+
+#include "time_zone.hpp"
+
+#include "date/date.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Range of event times (in the calendar time zone) to keep, other events are skipped while parsing.
+    struct EventWindow {
+        /// @brief Events which end before this time are skipped.
+        date::local_seconds begin = date::local_seconds::min();
+        /// @brief Events which start after this time are skipped.
+        date::local_seconds end = date::local_seconds::max();
+
+        /// @brief Creates a window from a range of UTC time, unbounded ends stay unbounded.
+        /// @param begin beginning of the range or sys_seconds::min()
+        /// @param end end of the range or sys_seconds::max()
+        /// @param zone calendar time zone
+        /// @return window in the calendar time zone
+        [[nodiscard]]
+        static EventWindow from_utc(date::sys_seconds begin, date::sys_seconds end, const TimeZone& zone) {
+            EventWindow window;
+            if (begin != date::sys_seconds::min()) {
+                window.begin = zone.to_local(begin);
+            }
+            if (end != date::sys_seconds::max()) {
+                window.end = zone.to_local(end);
+            }
+            return window;
+        }
+
+        /// @brief Checks whether an event overlaps the window.
+        /// @param start start of the event
+        /// @param finish end of the event
+        /// @return true if the event should be kept
+        [[nodiscard]]
+        bool contains(date::local_seconds start, date::local_seconds finish) const {
+            return finish >= begin && start <= end;
+        }
+    };
+
+}
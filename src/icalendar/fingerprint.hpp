@@ -0,0 +1,239 @@
+/// @file
+/// @brief Fast fingerprinting of iCalendar text fragments.
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Computes a non-cryptographic 64-bit hash of the text, reading 8 bytes at a time.
+    /// Much faster than std::hash for long strings, such as whole VEVENT blocks.
+    /// @param text text to hash
+    /// @return text fingerprint
+    [[nodiscard]]
+    std::uint64_t fingerprint(std::string_view text) {
+        constexpr std::uint64_t multiplier = 0x9E3779B97F4A7C15;
+        std::uint64_t hash = text.size() * multiplier;
+
+        const char* data = text.data();
+        std::size_t remaining = text.size();
+        for (; remaining >= 8; data += 8, remaining -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, data, 8);
+            hash = std::rotl((hash ^ word) * multiplier, 31);
+        }
+        std::uint64_t tail = 0;
+        // An empty view might have no data at all, and passing a null pointer to memcpy() is undefined.
+        if (remaining > 0) {
+            std::memcpy(&tail, data, remaining);
+        }
+        hash = (hash ^ tail) * multiplier;
+
+        // Final mixing, so that all input bits affect the lowest bits of the result.
+        hash ^= hash >> 32;
+        hash *= multiplier;
+        return hash ^ (hash >> 29);
+    }
+
+    /// @brief Combines fingerprints of consecutive fragments into a fingerprint of the whole sequence.
+    /// @param seed fingerprint of all previous fragments
+    /// @param next fingerprint of the next fragment
+    /// @return combined fingerprint
+    [[nodiscard]]
+    constexpr std::uint64_t combine_fingerprints(std::uint64_t seed, std::uint64_t next) {
+        return std::rotl((seed ^ next) * 0x9E3779B97F4A7C15, 31);
+    }
+
+    /// @brief 128-bit fingerprint of the contents of a calendar. Stable across runs and builds,
+    /// so that it can be saved together with the calendar and compared after a restart.
+    struct ContentFingerprint {
+        std::uint64_t low = 0;
+        std::uint64_t high = 0;
+
+        bool operator==(const ContentFingerprint&) const = default;
+    };
+
+    /// @brief Streaming fingerprint of raw iCalendar text, fed with chunks as they arrive, for example
+    /// straight from the network. Lines of DTSTAMP properties (with their folded continuation lines)
+    /// are skipped by a small state machine, because they change with every download. Other lines are hashed
+    /// in bulk, 16 bytes at a time in two independent lanes, with the round function of xxHash64.
+    /// The result does not depend on how the text is split into chunks.
+    class ContentHasher {
+        static constexpr std::uint64_t PRIME_1 = 0x9E3779B185EBCA87;
+        static constexpr std::uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4F;
+        static constexpr std::uint64_t PRIME_3 = 0x165667B19E3779F9;
+        /// @brief Name of the skipped property.
+        static constexpr std::string_view SKIPPED = "DTSTAMP";
+
+        /// @brief Position in the text relative to lines.
+        enum class State {
+            /// @brief At the first character of a line, which might be a fold.
+            LINE_START,
+            /// @brief Within a property name which matches the beginning of SKIPPED so far.
+            NAME,
+            /// @brief Within a hashed line.
+            LINE,
+            /// @brief Within a skipped line.
+            SKIP,
+            /// @brief At the first character after a skipped line, which might be a fold.
+            SKIP_BREAK,
+        } _state = State::LINE_START;
+        /// @brief Number of characters of SKIPPED matched in the NAME state, not hashed yet.
+        std::size_t _matched = 0;
+
+        /// @brief Hash lanes.
+        std::uint64_t _lanes[2] = { PRIME_1 + PRIME_2, PRIME_2 - PRIME_1 };
+        /// @brief Hashed bytes which do not fill a whole stripe yet.
+        char _stripe[16] = {};
+        /// @brief Number of bytes in _stripe.
+        std::size_t _buffered = 0;
+        /// @brief Number of hashed bytes.
+        std::uint64_t _length = 0;
+
+        /// @brief Mixes an input word into a lane.
+        [[nodiscard]]
+        static constexpr std::uint64_t round(std::uint64_t lane, std::uint64_t input) {
+            return std::rotl(lane + input * PRIME_2, 31) * PRIME_1;
+        }
+
+        /// @brief Mixes all bits of a lane, so that they affect all bits of the result.
+        [[nodiscard]]
+        static constexpr std::uint64_t avalanche(std::uint64_t hash) {
+            hash ^= hash >> 33;
+            hash *= PRIME_2;
+            hash ^= hash >> 29;
+            hash *= PRIME_3;
+            return hash ^ (hash >> 32);
+        }
+
+        /// @brief Hashes a whole stripe.
+        /// @param stripe 16 bytes
+        void consume(const char* stripe) {
+            std::uint64_t words[2];
+            std::memcpy(words, stripe, sizeof(words));
+            _lanes[0] = round(_lanes[0], words[0]);
+            _lanes[1] = round(_lanes[1], words[1]);
+        }
+
+        /// @brief Hashes bytes which are not skipped.
+        /// @param text bytes to hash
+        void absorb(std::string_view text) {
+            _length += text.size();
+            const char* data = text.data();
+            std::size_t size = text.size();
+            if (_buffered > 0) {
+                auto taken = std::min(sizeof(_stripe) - _buffered, size);
+                std::memcpy(_stripe + _buffered, data, taken);
+                _buffered += taken;
+                data += taken;
+                size -= taken;
+                if (_buffered < sizeof(_stripe)) {
+                    return;
+                }
+                consume(_stripe);
+                _buffered = 0;
+            }
+            for (; size >= sizeof(_stripe); data += sizeof(_stripe), size -= sizeof(_stripe)) {
+                consume(data);
+            }
+            std::memcpy(_stripe, data, size);
+            _buffered = size;
+        }
+
+    public:
+        /// @brief Hashes the next chunk of the text.
+        /// @param chunk next part of the text
+        void feed(std::string_view chunk) {
+            while (!chunk.empty()) {
+                switch (_state) {
+                    case State::LINE_START:
+                        if (chunk.front() == ' ' || chunk.front() == '\t') {
+                            _state = State::LINE;
+                        } else {
+                            _state = State::NAME;
+                            _matched = 0;
+                        }
+                        break;
+                    case State::SKIP_BREAK:
+                        if (chunk.front() == ' ' || chunk.front() == '\t') {
+                            _state = State::SKIP;
+                        } else {
+                            _state = State::NAME;
+                            _matched = 0;
+                        }
+                        break;
+                    case State::NAME: {
+                        const char c = chunk.front();
+                        if (_matched < SKIPPED.size() && c == SKIPPED[_matched]) {
+                            _matched++;
+                            chunk.remove_prefix(1);
+                        } else if (_matched == SKIPPED.size() && (c == ':' || c == ';')) {
+                            _state = State::SKIP;
+                        } else {
+                            // Not a DTSTAMP property, the matched part of the name is hashed after all.
+                            absorb(SKIPPED.substr(0, _matched));
+                            _state = State::LINE;
+                        }
+                        break;
+                    }
+                    case State::LINE:
+                    case State::SKIP: {
+                        auto line_end = chunk.find('\n');
+                        auto size = line_end == std::string_view::npos ? chunk.size() : line_end + 1;
+                        if (_state == State::LINE) {
+                            absorb(chunk.substr(0, size));
+                        }
+                        if (line_end != std::string_view::npos) {
+                            _state = _state == State::LINE ? State::LINE_START : State::SKIP_BREAK;
+                        }
+                        chunk.remove_prefix(size);
+                        break;
+                    }
+                }
+            }
+        }
+
+        /// @brief Computes the fingerprint of all text fed so far. More text can be fed afterwards.
+        /// @return content fingerprint
+        [[nodiscard]]
+        ContentFingerprint finish() const {
+            auto hasher = *this;
+            if (hasher._state == State::NAME) {
+                hasher.absorb(SKIPPED.substr(0, hasher._matched));
+            }
+            std::uint64_t tail[2] = {};
+            std::memcpy(tail, hasher._stripe, hasher._buffered);
+            auto first = hasher._lanes[0] ^ round(hasher._length * PRIME_3, tail[0]);
+            auto second = hasher._lanes[1] ^ round(hasher._length * PRIME_1, tail[1]);
+            return {
+                .low = avalanche(first + std::rotl(second, 27)),
+                .high = avalanche(second ^ std::rotl(first, 41) ^ PRIME_3),
+            };
+        }
+    };
+
+    /// @brief Computes the fingerprint of the whole raw text of a calendar at once, see ContentHasher.
+    /// @param text raw iCalendar text
+    /// @return content fingerprint
+    [[nodiscard]]
+    ContentFingerprint content_fingerprint(std::string_view text) {
+        ContentHasher hasher;
+        hasher.feed(text);
+        return hasher.finish();
+    }
+
+    /// @brief Hash function object based on usos_rpc::icalendar::fingerprint(), for unordered containers.
+    struct FingerprintHash {
+        [[nodiscard]]
+        std::size_t operator()(std::string_view text) const {
+            return static_cast<std::size_t>(fingerprint(text));
+        }
+    };
+
+}
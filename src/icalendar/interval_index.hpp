@@ -0,0 +1,91 @@
+/// @file
+/// @brief Index of event time intervals for stabbing and range queries.
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "event_record.hpp"
+
+#include "date/date.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Augmented sorted array of event intervals: start times in order,
+    /// with an implicit binary tree of maximal end times above them.
+    /// Finds all intervals overlapping a range in O((k + 1) log n) time, where k is the number of results.
+    class IntervalIndex {
+        /// @brief UTC start times of the events, in order of the events.
+        std::vector<date::sys_seconds> _starts;
+        /// @brief Implicit binary tree with the root at index 1 and leaves starting at index _leaves,
+        /// every node holds the latest end time of the events below it.
+        std::vector<date::sys_seconds> _latest_ends;
+        /// @brief Number of leaves of the tree, a power of two.
+        std::size_t _leaves = 0;
+
+        /// @brief Visits events overlapping the range, below the given node.
+        /// @param node tree node
+        /// @param first index of the first event below the node
+        /// @param count number of events below the node
+        /// @param limit number of events that start early enough
+        /// @param from beginning of the range
+        /// @param visit function called with indices of events
+        template <typename F>
+        void visit_node(
+            std::size_t node,
+            std::size_t first,
+            std::size_t count,
+            std::size_t limit,
+            date::sys_seconds from,
+            F& visit
+        ) const {
+            if (first >= limit || _latest_ends[node] < from) {
+                return;
+            }
+            if (count == 1) {
+                visit(first);
+                return;
+            }
+            visit_node(node * 2, first, count / 2, limit, from, visit);
+            visit_node(node * 2 + 1, first + count / 2, count / 2, limit, from, visit);
+        }
+
+    public:
+        IntervalIndex() = default;
+
+        /// @brief Builds the index for sorted events, which already have UTC times resolved.
+        /// @param events event records sorted by time of start
+        explicit IntervalIndex(std::span<const EventRecord> events) {
+            _starts.reserve(events.size());
+            for (const auto& event : events) {
+                _starts.push_back(event.utc_start);
+            }
+            _leaves = std::bit_ceil(std::max<std::size_t>(events.size(), 1));
+            _latest_ends.assign(_leaves * 2, date::sys_seconds::min());
+            for (std::size_t i = 0; i < events.size(); i++) {
+                _latest_ends[_leaves + i] = events[i].utc_end;
+            }
+            for (std::size_t node = _leaves - 1; node > 0; node--) {
+                _latest_ends[node] = std::max(_latest_ends[node * 2], _latest_ends[node * 2 + 1]);
+            }
+        }
+
+        /// @brief Calls the function with indices of all events which start no later than the end of the range
+        /// and end no earlier than its beginning, in order of the events.
+        /// @param from beginning of the range
+        /// @param to end of the range
+        /// @param visit function called with indices of events
+        template <typename F>
+        void visit_overlapping(date::sys_seconds from, date::sys_seconds to, F&& visit) const {
+            auto limit = static_cast<std::size_t>(std::ranges::upper_bound(_starts, to) - _starts.begin());
+            if (limit > 0) {
+                visit_node(1, 0, _leaves, limit, from, visit);
+            }
+        }
+    };
+
+}
@@ -4,102 +4,471 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
 #include <optional>
-#include <regex>
-#include <set>
-#include <string>
+#include <span>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "../exceptions.hpp"
 #include "../utilities.hpp"
 #include "calendar.hpp"
 #include "event.hpp"
+#include "event_window.hpp"
+#include "fingerprint.hpp"
+#include "property.hpp"
+#include "scanner.hpp"
+#include "time_zone.hpp"
+#include "timestamp.hpp"
+#include "vtimezone.hpp"
 
 namespace {
 
-    /// @brief Splits the iCalendar text into singular lines/properties.
-    /// @param text text of an iCalendar file
-    /// @return preprocessed vector of properties
-    [[nodiscard]]
-    std::vector<std::string> preprocess(const std::string& text) {
-        auto lines = usos_rpc::split(text, "\n");
-        auto iter = lines.begin();
-        while (iter != lines.end()) {
-            auto current = usos_rpc::strip(*iter);
-            if (current.empty()) {
-                iter = lines.erase(iter);
+    /// @brief Checks whether a decoded content line is a DTSTAMP property.
+    /// @param line content line
+    /// @return result of the check
+    constexpr bool is_dtstamp(std::string_view line) {
+        return line.size() > 7 && line.starts_with("DTSTAMP") && (line[7] == ':' || line[7] == ';');
+    }
+
+    /// @brief Unfolds and unescapes the iCalendar text in a single pass.
+    /// Continuation lines are joined, CR/LF characters are dropped, blank lines are skipped
+    /// and escape sequences (a backslash followed by n, N, a comma, a semicolon or a backslash) are decoded,
+    /// all in one scan and without any intermediate strings. Runs of regular characters are found
+    /// with a vectorized search and copied in bulk. The text is decoded in place, which is possible
+    /// because decoding never makes it longer.
+    /// Decoded lines are separated with a single CR, which never occurs inside of them,
+    /// so that any range of lines is also an unambiguous contiguous string.
+    /// DTSTAMP properties are dropped like blank lines, because they change with every download and are never used.
+    /// @param text text of an iCalendar file, overwritten with decoded properties
+    /// @param lines cleared and filled with preprocessed properties (views into the text),
+    /// so that its memory can be reused between calls
+    void preprocess(std::span<char> text, std::vector<std::string_view>& lines) {
+        char* const data = text.data();
+        std::size_t out = 0;
+        std::size_t line_start = 0;
+        // End of the last character that is not trailing whitespace of the current line.
+        std::size_t content_end = 0;
+
+        lines.clear();
+        auto finish_line = [&]() {
+            if (content_end > line_start
+                && !is_dtstamp(std::string_view(data + line_start, content_end - line_start))) {
+                lines.emplace_back(data + line_start, content_end - line_start);
+                line_start = content_end;
+                // Every line ends with at least one consumed LF, so there is always room for the separator.
+                if (line_start < text.size()) {
+                    data[line_start++] = '\r';
+                }
+            }
+            out = content_end = line_start;  // Trailing whitespace and blank lines are dropped.
+        };
+
+        enum class State {
+            /// @brief Regular property text.
+            TEXT,
+            /// @brief Directly after a backslash.
+            ESCAPE,
+            /// @brief Directly after a line feed, which might be a fold.
+            LINE_BREAK,
+        } state = State::TEXT;
+        bool escape_before_break = false;
+
+        const char* read = data;
+        const char* const end = data + text.size();
+        while (read != end) {  // Writes never overtake reads.
+            if (state == State::TEXT) {
+                // Copy the whole run of regular characters at once.
+                const char* special = usos_rpc::icalendar::find_special_character(read, end);
+                if (special != read) {
+                    const auto run = static_cast<std::size_t>(special - read);
+                    std::memmove(data + out, read, run);
+                    out += run;
+                    auto last = out;
+                    while (last > content_end && (data[last - 1] == ' ' || data[last - 1] == '\t')) {
+                        last--;
+                    }
+                    content_end = last;
+                    read = special;
+                    if (read == end) {
+                        break;
+                    }
+                }
+            }
+
+            const char c = *read++;
+            if (c == '\r') {
                 continue;
             }
 
-            if (iter->starts_with(" ")) {
-                auto previous = iter - 1;
-                previous->append(current);
-                iter = lines.erase(iter);
+            if (state == State::LINE_BREAK) {
+                if (c == ' ' || c == '\t') {
+                    // Folded line - the break and a single whitespace character are removed.
+                    state = escape_before_break ? State::ESCAPE : State::TEXT;
+                    continue;
+                }
+                if (escape_before_break) {
+                    data[out++] = '\\';
+                    content_end = out;
+                }
+                finish_line();
+                state = State::TEXT;
+            }
+
+            if (c == '\n') {
+                escape_before_break = state == State::ESCAPE;
+                state = State::LINE_BREAK;
+                continue;
+            }
+
+            if (state == State::ESCAPE) {
+                switch (c) {
+                    case 'n':
+                    case 'N':
+                        data[out++] = '\n';
+                        break;
+                    case ',':
+                    case ';':
+                    case '\\':
+                        data[out++] = c;
+                        break;
+                    default:  // Not a valid escape sequence, left as is.
+                        data[out++] = '\\';
+                        data[out++] = c;
+                        break;
+                }
+                content_end = out;
+                state = State::TEXT;
+            } else if (c == '\\') {
+                state = State::ESCAPE;
             } else {
-                *iter = current;
-                iter++;
+                data[out++] = c;
+                if (c != ' ' && c != '\t') {
+                    content_end = out;
+                }
             }
         }
-        return lines;
+
+        if (state == State::ESCAPE || (state == State::LINE_BREAK && escape_before_break)) {
+            data[out++] = '\\';
+            content_end = out;
+        }
+        finish_line();
     }
 
-    /// @brief Regular expression for backslash-n sequence.
-    const std::regex NEWLINE(R"(\\n)");
-    /// @brief Regular expression for backslash-comma sequence.
-    const std::regex COMMA(R"(\\,)");
-
-    /// @brief Fixes escaped characters in the iCalendar text.
-    /// @param lines vector of properties
-    void fix_escapes(std::vector<std::string>& lines) {
-        std::for_each(lines.begin(), lines.end(), [](std::string& line) {
-            line = std::regex_replace(line, NEWLINE, "\n");
-            line = std::regex_replace(line, COMMA, ",");
-        });
+    /// @brief Preprocesses iCalendar text like the overload above, into a new vector.
+    /// @param text text of an iCalendar file, overwritten with decoded properties
+    /// @return preprocessed vector of properties (views into the text)
+    [[nodiscard]]
+    std::vector<std::string_view> preprocess(std::span<char> text) {
+        std::vector<std::string_view> lines;
+        preprocess(text, lines);
+        return lines;
     }
 
-    using lines_iterator = std::vector<std::string>::const_iterator;
+    using lines_iterator = std::vector<std::string_view>::const_iterator;
+
+    /// @brief Range of lines of a top-level component, like VEVENT, from its BEGIN line to its END line.
+    struct EventBlock {
+        lines_iterator begin;
+        lines_iterator end;
 
-    /// @brief Extracts a property from the iCalendar text.
-    /// @param begin beginning of the line range
-    /// @param end end of the line range
-    /// @param name property name
-    /// @return property value or std::nullopt when not found
+        /// @brief Returns decoded text of the whole block, including the BEGIN and END lines.
+        /// @return block text
+        [[nodiscard]]
+        std::string_view text() const {
+            return { begin->data(), end->data() + end->size() };
+        }
+    };
+
+    /// @brief Converts a DTSTART or DTEND property to the wall clock time of the calendar.
+    /// Supports floating and UTC values, values with a TZID parameter and DATE values.
+    /// @param content property to convert
+    /// @param zones calendar time zones
+    /// @return time in the calendar time zone
+    /// @throws usos_rpc::Exception when the value or its time zone is invalid
     [[nodiscard]]
-    std::optional<std::string> get_optional_property(
-        const lines_iterator& begin, const lines_iterator& end, const std::string& name
+    date::local_seconds to_calendar_time(
+        const usos_rpc::icalendar::ContentLine& content,
+        const usos_rpc::icalendar::CalendarZones& zones
     ) {
-        auto iter = std::find_if(begin, end, [&name](const std::string& line) {
-            return line.starts_with(name);
-        });
-        if (iter == end) {
+        using namespace usos_rpc;
+        auto timestamp = icalendar::parse_timestamp(content.value);
+        if (!timestamp.has_value()) {
+            throw Exception(ExceptionType::ICALENDAR, "Could not parse event timestamp!");
+        }
+        if (timestamp->utc) {
+            return zones.calendar.to_local(date::sys_seconds(timestamp->time.time_since_epoch()));
+        }
+
+        auto tzid = content.parameter("TZID");
+        if (!tzid.has_value() || tzid.value() == zones.calendar.name()) {
+            return timestamp->time;
+        }
+        return zones.calendar.to_local(timestamp->to_sys(zones.find(tzid.value())));
+    }
+
+    /// @brief Creates an event from its VEVENT block, scanning the block only once.
+    /// Properties of nested components (like VALARM) are ignored.
+    /// Events outside of the window are skipped right after their times are known, before any other work.
+    /// @param block lines of the event
+    /// @param zones calendar time zones
+    /// @param window events to keep
+    /// @return parsed event or nullopt if it is outside of the window
+    /// @throws usos_rpc::Exception when a property is missing or invalid
+    [[nodiscard]]
+    std::optional<usos_rpc::icalendar::Event> parse_event(
+        const EventBlock& block,
+        const usos_rpc::icalendar::CalendarZones& zones,
+        const usos_rpc::icalendar::EventWindow& window
+    ) {
+        using namespace usos_rpc::icalendar;
+        std::array<std::optional<ContentLine>, PROPERTY_NAMES.size()> properties;
+        int depth = 0;
+        for (auto line = block.begin + 1; line != block.end; line++) {
+            auto content = split_content_line(*line);
+            auto property = find_property(content.name);
+            if (property == Property::BEGIN) {
+                depth++;
+            } else if (property == Property::END) {
+                depth--;
+            } else if (depth == 0 && property != Property::UNKNOWN) {
+                auto& slot = properties[static_cast<std::size_t>(property)];
+                if (!slot.has_value()) {
+                    slot = content;
+                }
+            }
+        }
+
+        auto get = [&properties](Property property) {
+            const auto& slot = properties[static_cast<std::size_t>(property)];
+            if (!slot.has_value()) {
+                throw usos_rpc::Exception(
+                    usos_rpc::ExceptionType::ICALENDAR,
+                    "Missing property: {}",
+                    PROPERTY_NAMES[static_cast<std::size_t>(property)]
+                );
+            }
+            return slot.value();
+        };
+        auto start = to_calendar_time(get(Property::DTSTART), zones);
+        auto end = to_calendar_time(get(Property::DTEND), zones);
+        if (!window.contains(start, end)) {
             return std::nullopt;
         }
-        return iter->substr(name.size() + 1);
+        const auto& location = properties[static_cast<std::size_t>(Property::LOCATION)];
+        return Event(
+            get(Property::SUMMARY).value,
+            start,
+            end,
+            get(Property::UID).value,
+            get(Property::DESCRIPTION).value,
+            location.transform([](const ContentLine& content) {
+                return content.value;
+            }),
+            block.text()
+        );
     }
 
-    /// @brief Extracts a property from the iCalendar text.
-    /// @param begin beginning of the line range
-    /// @param end end of the line range
-    /// @param name property name
-    /// @return property value
-    /// @throws usos_rpc::Exception when the property is missing
+    /// @brief Takes an event from the previous version of the calendar if its block has not changed,
+    /// otherwise parses the block.
+    /// @param block lines of the event
+    /// @param zones calendar time zones
+    /// @param previous previous version of the calendar (with the same time zone) or nullptr
+    /// @param window events to keep
+    /// @return reused or parsed event, or nullopt if it is outside of the window
+    /// @throws usos_rpc::Exception when a property is missing or invalid
     [[nodiscard]]
-    std::string get_property(const lines_iterator& begin, const lines_iterator& end, const std::string& name) {
-        auto prop = get_optional_property(begin, end, name);
-        if (prop.has_value()) {
-            return prop.value();
+    std::optional<usos_rpc::icalendar::Event> make_event(
+        const EventBlock& block,
+        const usos_rpc::icalendar::CalendarZones& zones,
+        const usos_rpc::icalendar::Calendar* previous,
+        const usos_rpc::icalendar::EventWindow& window
+    ) {
+        if (previous != nullptr) {
+            if (auto event = previous->reuse_event(block.text())) {
+                // The window might have moved since the previous version.
+                if (!window.contains(event->start(), event->end())) {
+                    return std::nullopt;
+                }
+                return event;
+            }
         }
-        throw usos_rpc::Exception(usos_rpc::ExceptionType::ICALENDAR, "Missing property: {}", name);
+        return parse_event(block, zones, window);
     }
 
-    /// @brief Extracts a property from the iCalendar text.
-    /// @param lines vector of properties
-    /// @param name property name
+    /// @brief Values of top-level calendar properties, indexed by usos_rpc::icalendar::Property.
+    using CalendarProperties =
+        std::array<std::optional<std::string_view>, usos_rpc::icalendar::PROPERTY_NAMES.size()>;
+
+    /// @brief Returns the value of a calendar property that has to be present.
+    /// @param properties calendar properties
+    /// @param property property to get
     /// @return property value
     /// @throws usos_rpc::Exception when the property is missing
     [[nodiscard]]
-    std::string get_property(const std::vector<std::string>& lines, const std::string& name) {
-        return get_property(lines.begin(), lines.end(), name);
+    std::string_view required_property(const CalendarProperties& properties, usos_rpc::icalendar::Property property) {
+        const auto& slot = properties[static_cast<std::size_t>(property)];
+        if (!slot.has_value()) {
+            throw usos_rpc::Exception(
+                usos_rpc::ExceptionType::ICALENDAR,
+                "Missing property: {}",
+                usos_rpc::icalendar::PROPERTY_NAMES[static_cast<std::size_t>(property)]
+            );
+        }
+        return slot.value();
+    }
+
+    /// @brief Parses events one by one on the current thread.
+    /// @param blocks VEVENT blocks in document order
+    /// @param zones calendar time zones
+    /// @param previous previous version of the calendar to reuse events from or nullptr
+    /// @param window events to keep
+    /// @param events list to append parsed events to
+    /// @return true if at least one event could not be parsed
+    bool parse_events(
+        const std::vector<EventBlock>& blocks,
+        const usos_rpc::icalendar::CalendarZones& zones,
+        const usos_rpc::icalendar::Calendar* previous,
+        const usos_rpc::icalendar::EventWindow& window,
+        std::vector<usos_rpc::icalendar::Event>& events
+    ) {
+        bool event_fail = false;
+        for (const auto& block : blocks) {
+            try {
+                if (auto event = make_event(block, zones, previous, window)) {
+                    events.push_back(std::move(event.value()));
+                }
+            } catch (const usos_rpc::Exception& err) {
+                event_fail = true;
+            }
+        }
+        return event_fail;
+    }
+
+    /// @brief Parses events on a pool of worker threads, which take chunks of blocks from a shared counter.
+    /// Every chunk is sorted by its worker, then all chunks are merged in document order, so that duplicates
+    /// are resolved exactly like after parse_events().
+    /// @param blocks VEVENT blocks in document order
+    /// @param zones calendar time zones
+    /// @param previous previous version of the calendar to reuse events from or nullptr
+    /// @param window events to keep
+    /// @param threads maximal number of worker threads
+    /// @param events list to append parsed events to, in sorted order
+    /// @return true if at least one event could not be parsed
+    /// @throws anything else thrown while parsing an event, rethrown on the calling thread like in parse_events()
+    bool parse_events_parallel(
+        const std::vector<EventBlock>& blocks,
+        const usos_rpc::icalendar::CalendarZones& zones,
+        const usos_rpc::icalendar::Calendar* previous,
+        const usos_rpc::icalendar::EventWindow& window,
+        unsigned threads,
+        std::vector<usos_rpc::icalendar::Event>& events
+    ) {
+        using usos_rpc::icalendar::Event;
+        // A few chunks per thread to balance the load without much synchronization.
+        const std::size_t chunk_size = std::max<std::size_t>(blocks.size() / (threads * 4), 16);
+        const std::size_t chunk_count = (blocks.size() + chunk_size - 1) / chunk_size;
+
+        std::vector<std::vector<Event>> chunks(chunk_count);
+        // Exceptions cannot leave a worker thread, so they are kept until all workers have finished.
+        std::vector<std::exception_ptr> errors(chunk_count);
+        std::atomic<std::size_t> next_chunk = 0;
+        std::atomic<bool> event_fail = false;
+        auto worker = [&]() {
+            for (auto chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+                auto first = blocks.begin() + chunk * chunk_size;
+                auto last = blocks.begin() + std::min((chunk + 1) * chunk_size, blocks.size());
+                auto& result = chunks[chunk];
+                try {
+                    for (auto block = first; block != last; block++) {
+                        try {
+                            if (auto event = make_event(*block, zones, previous, window)) {
+                                result.push_back(std::move(event.value()));
+                            }
+                        } catch (const usos_rpc::Exception& err) {
+                            event_fail = true;
+                        }
+                    }
+                    std::stable_sort(result.begin(), result.end());
+                } catch (...) {
+                    errors[chunk] = std::current_exception();
+                }
+            }
+        };
+        {
+            std::vector<std::jthread> pool;
+            for (std::size_t i = 1; i < std::min<std::size_t>(threads, chunk_count); i++) {
+                pool.emplace_back(worker);
+            }
+            worker();
+        }
+        // The first error in document order is the one parse_events() would have thrown.
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        // Bottom-up merge of neighbouring chunks keeps equal events in document order.
+        std::vector<Event> merged;
+        merged.reserve(blocks.size());
+        std::vector<std::size_t> bounds { 0 };
+        for (auto& chunk : chunks) {
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(merged));
+            bounds.push_back(merged.size());
+        }
+        for (std::size_t width = 1; width < chunk_count; width *= 2) {
+            for (std::size_t i = 0; i + width < chunk_count; i += 2 * width) {
+                std::inplace_merge(
+                    merged.begin() + bounds[i],
+                    merged.begin() + bounds[i + width],
+                    merged.begin() + bounds[std::min(i + 2 * width, chunk_count)]
+                );
+            }
+        }
+
+        std::move(merged.begin(), merged.end(), std::back_inserter(events));
+        return event_fail;
+    }
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Parser settings.
+    struct ParseOptions {
+        /// @brief Number of threads used to parse events, 0 means the number of logical processors.
+        unsigned threads = 1;
+        /// @brief Minimal text size (in bytes) for which events are parsed in parallel.
+        std::size_t parallel_threshold = 512 * 1024;
+        /// @brief Events which end before this time are skipped.
+        date::sys_seconds window_begin = date::sys_seconds::min();
+        /// @brief Events which start after this time are skipped.
+        date::sys_seconds window_end = date::sys_seconds::max();
+    };
+
+    /// @brief Mixes the event window into a content fingerprint, so that moving the window
+    /// makes the calendar different even if its data is the same.
+    /// @param fingerprint fingerprint of the raw calendar text
+    /// @param options parser settings
+    /// @return fingerprint of the parsed calendar
+    [[nodiscard]]
+    ContentFingerprint windowed_fingerprint(ContentFingerprint fingerprint, const ParseOptions& options) {
+        if (options.window_begin == date::sys_seconds::min() && options.window_end == date::sys_seconds::max()) {
+            return fingerprint;
+        }
+        const std::uint64_t begin = options.window_begin.time_since_epoch().count();
+        const std::uint64_t end = options.window_end.time_since_epoch().count();
+        return {
+            .low = combine_fingerprints(combine_fingerprints(fingerprint.low, begin), end),
+            .high = combine_fingerprints(combine_fingerprints(fingerprint.high, end), begin),
+        };
     }
 
 }
@@ -107,54 +476,91 @@ namespace {
 namespace usos_rpc::icalendar {
 
     /// @brief Parses given text into a Calendar object.
+    /// The text is copied once into the memory arena of the calendar and decoded there,
+    /// all events and calendar properties are views into that buffer.
+    /// Large calendars have their events parsed on multiple threads, with exactly the same result.
+    /// Events whose VEVENT blocks did not change since the previous version of the calendar
+    /// are copied from it instead of being parsed again. Events outside of the window from the options are skipped.
+    /// Time zones defined by VTIMEZONE components are compiled and take precedence over the time zone database.
     /// @param text text of an iCalendar file
+    /// @param options parser settings
+    /// @param previous previous version of the same calendar or nullptr
     /// @return parsed calendar data
     /// @throws usos_rpc::Exception when parsing fails
     [[nodiscard]]
-    Calendar parse(std::string text) {
-        auto lines = preprocess(text);
-        fix_escapes(lines);
+    Calendar parse(std::string_view text, const ParseOptions& options = {}, const Calendar* previous = nullptr) {
+        // Room for the decoded text and for the event records, their dictionary and the event cache.
+        auto arena = std::make_unique<Calendar::Arena>(text.size() * 2);
+        std::span<char> buffer(arena->allocate_text(text.size()), text.size());
+        std::copy(text.begin(), text.end(), buffer.begin());
+
+        auto lines = preprocess(buffer);
         if (lines.empty() || !lines.front().starts_with("BEGIN:VCALENDAR")
             || !lines.back().starts_with("END:VCALENDAR")) {
             throw Exception(ExceptionType::ICALENDAR, "Invalid iCalendar file!");
         }
 
-        bool event_fail = false;
-        std::set<Event> events;
-        auto iter = lines.begin() + 1;
-        while (iter != lines.end() - 1) {
-            if (iter->starts_with("BEGIN:VEVENT")) {
-                auto end = std::find(iter, lines.end() - 1, "END:VEVENT");
-
-                try {
-                    auto dtstart = get_property(iter, end, "DTSTART").substr(const_string_length("VALUE=DATE-TIME:"));
-                    auto dtend = get_property(iter, end, "DTEND").substr(const_string_length("VALUE=DATE-TIME:"));
-                    Event event(
-                        get_property(iter, end, "SUMMARY"),
-                        dtstart,
-                        dtend,
-                        get_property(iter, end, "UID"),
-                        get_property(iter, end, "DESCRIPTION"),
-                        get_optional_property(iter, end, "LOCATION")
-                    );
-                    events.insert(event);
-                } catch (const Exception& err) {
-                    event_fail = true;
+        // Find all event blocks and calendar properties first, so that events can be parsed independently.
+        std::vector<EventBlock> blocks;
+        std::vector<TimeZone> defined_zones;
+        CalendarProperties calendar_properties;
+        int depth = 0;
+        auto component_begin = lines.begin();
+        for (auto line = lines.begin() + 1; line != lines.end() - 1; line++) {
+            if (line->starts_with("BEGIN:")) {
+                if (depth++ == 0) {
+                    component_begin = line;
+                }
+            } else if (line->starts_with("END:")) {
+                if (--depth == 0 && *component_begin == "BEGIN:VEVENT") {
+                    blocks.push_back({ component_begin, line });
+                } else if (depth == 0 && *component_begin == "BEGIN:VTIMEZONE") {
+                    if (auto zone = compile_time_zone({ component_begin, line + 1 })) {
+                        defined_zones.push_back(std::move(zone.value()));
+                    }
+                }
+            } else if (depth == 0) {
+                auto content = split_content_line(*line);
+                auto& slot = calendar_properties[static_cast<std::size_t>(find_property(content.name))];
+                if (!slot.has_value()) {
+                    slot = content.value;
                 }
-
-                iter = end + 1;
-            } else {
-                iter++;
             }
         }
+
+        auto prodid = required_property(calendar_properties, Property::PRODID);
+        auto calname = required_property(calendar_properties, Property::X_WR_CALNAME);
+        auto timezone = required_property(calendar_properties, Property::X_WR_TIMEZONE);
+        // Resolved before parsing events, as their timestamps might need to be converted to it.
+        const CalendarZones zones(timezone, std::move(defined_zones));
+
+        // Times of reused events are already converted to the time zone of the previous version.
+        if (previous != nullptr && previous->time_zone() != zones.calendar) {
+            previous = nullptr;
+        }
+
+        auto window = EventWindow::from_utc(options.window_begin, options.window_end, zones.calendar);
+        std::vector<Event> events;
+        events.reserve(blocks.size());
+        auto threads = options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+        bool event_fail = threads > 1 && text.size() >= options.parallel_threshold
+            ? parse_events_parallel(blocks, zones, previous, window, threads, events)
+            : parse_events(blocks, zones, previous, window, events);
         if (event_fail && events.empty()) {
             throw Exception(ExceptionType::ICALENDAR, "Could not parse events!");
         }
+        arena->store_events(events);
 
-        auto prodid = get_property(lines, "PRODID");
-        auto calname = get_property(lines, "X-WR-CALNAME");
-        auto timezone = get_property(lines, "X-WR-TIMEZONE");
-        return Calendar(calname, prodid, timezone, events);
+        auto fingerprint = windowed_fingerprint(content_fingerprint(text), options);
+        return Calendar(
+            std::move(arena),
+            calname,
+            prodid,
+            zones.calendar,
+            fingerprint,
+            options.window_begin,
+            options.window_end
+        );
     }
 
 }
@@ -0,0 +1,195 @@
+/// @file
+/// @brief iCalendar content line splitting and compile-time property name lookup.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Properties recognized by the parser.
+    enum class Property : std::uint8_t {
+        /// @brief Any property not listed below.
+        UNKNOWN,
+        /// @brief Beginning of a component.
+        BEGIN,
+        /// @brief End of a component.
+        END,
+        /// @brief Product identifier of the calendar.
+        PRODID,
+        /// @brief Calendar name.
+        X_WR_CALNAME,
+        /// @brief Calendar time zone.
+        X_WR_TIMEZONE,
+        /// @brief Start of an event.
+        DTSTART,
+        /// @brief End of an event.
+        DTEND,
+        /// @brief Event subject and type.
+        SUMMARY,
+        /// @brief Unique identifier of an event.
+        UID,
+        /// @brief Event description, contains room, building and URL.
+        DESCRIPTION,
+        /// @brief Event address.
+        LOCATION,
+        /// @brief Time of generating the event, changes with every download.
+        DTSTAMP,
+    };
+
+    /// @brief Names of the properties, indexed by usos_rpc::icalendar::Property.
+    constexpr std::array<std::string_view, 13> PROPERTY_NAMES {
+        "", "BEGIN", "END", "PRODID", "X-WR-CALNAME", "X-WR-TIMEZONE",
+        "DTSTART", "DTEND", "SUMMARY", "UID", "DESCRIPTION", "LOCATION", "DTSTAMP",
+    };
+
+    /// @brief Single content line split into its parts, for example
+    /// DTSTART;TZID=Europe/Warsaw;VALUE=DATE-TIME:20240101T081500 is split into "DTSTART",
+    /// "TZID=Europe/Warsaw;VALUE=DATE-TIME" and "20240101T081500".
+    struct ContentLine {
+        /// @brief Property name.
+        std::string_view name;
+        /// @brief Raw parameter list without the leading semicolon, may be empty.
+        std::string_view parameters;
+        /// @brief Property value.
+        std::string_view value;
+
+        /// @brief Finds the value of a parameter.
+        /// @param parameter_name name of the parameter to find
+        /// @return parameter value without quotes or nullopt when the parameter is missing
+        [[nodiscard]]
+        constexpr std::optional<std::string_view> parameter(std::string_view parameter_name) const {
+            std::size_t start = 0;
+            while (start < parameters.size()) {
+                // Semicolons inside quoted values do not separate parameters.
+                auto end = start;
+                bool quoted = false;
+                while (end < parameters.size() && (quoted || parameters[end] != ';')) {
+                    quoted ^= parameters[end] == '"';
+                    end++;
+                }
+
+                auto parameter = parameters.substr(start, end - start);
+                auto equals = parameter.find('=');
+                if (equals != std::string_view::npos && parameter.substr(0, equals) == parameter_name) {
+                    auto parameter_value = parameter.substr(equals + 1);
+                    if (parameter_value.size() >= 2 && parameter_value.front() == '"'
+                        && parameter_value.back() == '"') {
+                        parameter_value = parameter_value.substr(1, parameter_value.size() - 2);
+                    }
+                    return parameter_value;
+                }
+                start = end + 1;
+            }
+            return std::nullopt;
+        }
+    };
+
+    /// @brief Splits a content line into name, parameters and value.
+    /// Colons inside quoted parameter values are handled correctly.
+    /// @param line unfolded content line
+    /// @return split line; a line without a colon has an empty value
+    [[nodiscard]]
+    constexpr ContentLine split_content_line(std::string_view line) {
+        auto name_end = line.find_first_of(";:");
+        if (name_end == std::string_view::npos) {
+            return { .name = line, .parameters = {}, .value = {} };
+        }
+
+        auto value_start = name_end;
+        if (line[name_end] == ';') {
+            bool quoted = false;
+            while (value_start < line.size() && (quoted || line[value_start] != ':')) {
+                quoted ^= line[value_start] == '"';
+                value_start++;
+            }
+        }
+
+        auto parameters_start = std::min(name_end + 1, value_start);
+        return {
+            .name = line.substr(0, name_end),
+            .parameters = line.substr(parameters_start, value_start - parameters_start),
+            .value = value_start < line.size() ? line.substr(value_start + 1) : std::string_view(),
+        };
+    }
+
+}
+
+namespace {
+
+    /// @brief Size of the property lookup table, a power of two.
+    constexpr std::size_t PROPERTY_TABLE_BITS = 5;
+
+    /// @brief Multiplicative hash of a property name based on its length and its first and last characters.
+    /// @param name property name, must not be empty
+    /// @param seed hash multiplier
+    /// @return index in the property lookup table
+    constexpr std::size_t property_hash(std::string_view name, std::uint32_t seed) {
+        const auto key = static_cast<std::uint32_t>(static_cast<unsigned char>(name.front()))
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(name.back())) << 8
+            | static_cast<std::uint32_t>(name.size()) << 16;
+        return (key * seed) >> (32 - PROPERTY_TABLE_BITS);
+    }
+
+    /// @brief Checks whether a seed maps every known property to a different slot.
+    /// @param seed hash multiplier
+    /// @return true if the hash is perfect for the given seed
+    constexpr bool is_perfect_seed(std::uint32_t seed) {
+        std::array<bool, 1 << PROPERTY_TABLE_BITS> used {};
+        for (std::size_t i = 1; i < usos_rpc::icalendar::PROPERTY_NAMES.size(); i++) {
+            auto slot = property_hash(usos_rpc::icalendar::PROPERTY_NAMES[i], seed);
+            if (used[slot]) {
+                return false;
+            }
+            used[slot] = true;
+        }
+        return true;
+    }
+
+    /// @brief Finds the first odd seed for which the hash is perfect. Evaluated at compile time only.
+    /// @return seed or 0 if none was found
+    consteval std::uint32_t find_perfect_seed() {
+        for (std::uint32_t seed = 0x9E3779B1; seed < 0x9E3779B1 + 200000; seed += 2) {
+            if (is_perfect_seed(seed)) {
+                return seed;
+            }
+        }
+        return 0;
+    }
+
+    /// @brief Multiplier of the perfect hash for known property names.
+    constexpr std::uint32_t PROPERTY_SEED = find_perfect_seed();
+    static_assert(PROPERTY_SEED != 0, "No perfect hash seed found for property names!");
+
+    /// @brief Property lookup table, maps hash values to properties.
+    constexpr auto PROPERTY_TABLE = []() {
+        using usos_rpc::icalendar::Property;
+        std::array<Property, 1 << PROPERTY_TABLE_BITS> table {};
+        for (std::size_t i = 1; i < usos_rpc::icalendar::PROPERTY_NAMES.size(); i++) {
+            table[property_hash(usos_rpc::icalendar::PROPERTY_NAMES[i], PROPERTY_SEED)] = static_cast<Property>(i);
+        }
+        return table;
+    }();
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Recognizes a property by its name with a single table lookup and a single comparison.
+    /// @param name property name
+    /// @return recognized property or Property::UNKNOWN
+    [[nodiscard]]
+    constexpr Property find_property(std::string_view name) {
+        if (name.empty()) {
+            return Property::UNKNOWN;
+        }
+        auto candidate = PROPERTY_TABLE[property_hash(name, PROPERTY_SEED)];
+        return PROPERTY_NAMES[static_cast<std::size_t>(candidate)] == name ? candidate : Property::UNKNOWN;
+    }
+
+}
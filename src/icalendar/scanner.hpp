@@ -0,0 +1,147 @@
+/// @file
+/// @brief Vectorized search for characters that are significant to the iCalendar tokenizer.
+
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define USOS_RPC_SIMD_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define USOS_RPC_TARGET_AVX2
+    #else
+        #define USOS_RPC_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+namespace {
+
+    /// @brief Checks whether a character needs special handling by the tokenizer.
+    /// @param c character to check
+    /// @return true for line breaks (CR, LF) and backslashes (escape sequences)
+    constexpr bool is_special_character(char c) {
+        return c == '\r' || c == '\n' || c == '\\';
+    }
+
+    /// @brief Portable byte-at-a-time fallback of the special character search.
+    /// @param begin beginning of the text
+    /// @param end end of the text
+    /// @return pointer to the first special character or end
+    const char* find_special_scalar(const char* begin, const char* end) {
+        while (begin != end && !is_special_character(*begin)) {
+            begin++;
+        }
+        return begin;
+    }
+
+#ifdef USOS_RPC_SIMD_X86
+
+    /// @brief SSE2 version of the special character search, checks 16 bytes at a time.
+    /// SSE2 is always available on x86-64.
+    /// @param begin beginning of the text
+    /// @param end end of the text
+    /// @return pointer to the first special character or end
+    const char* find_special_sse2(const char* begin, const char* end) {
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        while (end - begin >= 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            const __m128i matches = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf)), _mm_cmpeq_epi8(chunk, backslash)
+            );
+            const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+            if (mask != 0) {
+                return begin + std::countr_zero(mask);
+            }
+            begin += 16;
+        }
+        return find_special_scalar(begin, end);
+    }
+
+    /// @brief AVX2 version of the special character search, checks 32 bytes at a time.
+    /// Most runs between special characters are short, so the first 16 bytes are checked with
+    /// (VEX-encoded) 128-bit instructions before switching to full 256-bit blocks.
+    /// @param begin beginning of the text
+    /// @param end end of the text
+    /// @return pointer to the first special character or end
+    USOS_RPC_TARGET_AVX2 const char* find_special_avx2(const char* begin, const char* end) {
+        const __m256i cr = _mm256_set1_epi8('\r');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        if (end - begin >= 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            const __m128i matches = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(cr)), _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(lf))
+                ),
+                _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(backslash))
+            );
+            const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+            if (mask != 0) {
+                return begin + std::countr_zero(mask);
+            }
+            begin += 16;
+        }
+        while (end - begin >= 32) {
+            const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            const __m256i matches = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)),
+                _mm256_cmpeq_epi8(chunk, backslash)
+            );
+            const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+            if (mask != 0) {
+                return begin + std::countr_zero(mask);
+            }
+            begin += 32;
+        }
+        return find_special_scalar(begin, end);
+    }
+
+    /// @brief Checks whether both the processor and the operating system support AVX2.
+    /// @return result of the check
+    bool cpu_supports_avx2() {  // clang-format off
+        #ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0b110) == 0b110;
+            __cpuidex(info, 7, 0);
+            return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+        #else
+            return __builtin_cpu_supports("avx2");
+        #endif
+    }  // clang-format on
+
+#endif
+
+    using find_special_function = const char* (*) (const char*, const char*);
+
+    /// @brief Chooses the fastest special character search supported by the current processor.
+    /// @return search function
+    find_special_function select_find_special() {  // clang-format off
+        #ifdef USOS_RPC_SIMD_X86
+            return cpu_supports_avx2() ? find_special_avx2 : find_special_sse2;
+        #else
+            return find_special_scalar;
+        #endif
+    }  // clang-format on
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Finds the first line break (CR or LF) or backslash in the text.
+    /// Uses AVX2 or SSE2 when available (chosen once at runtime), otherwise a scalar loop.
+    /// @param begin beginning of the text
+    /// @param end end of the text
+    /// @return pointer to the first special character or end if there are none
+    [[nodiscard]]
+    const char* find_special_character(const char* begin, const char* end) {
+        static const find_special_function implementation = select_find_special();
+        return implementation(begin, end);
+    }
+
+}
@@ -0,0 +1,324 @@
+/// @file
+/// @brief Binary snapshots of parsed calendars, used directly from a memory-mapped file.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "../exceptions.hpp"
+#include "../files.hpp"
+#include "calendar.hpp"
+#include "event_record.hpp"
+#include "fingerprint.hpp"
+#include "time_zone.hpp"
+#include "zone_offsets.hpp"
+
+#include "date/date.h"
+#include "date/tz.h"
+
+namespace {
+
+    /// @brief Reference to a string stored in the string section of a snapshot.
+    struct SnapshotString {
+        /// @brief Offset from the beginning of the string section.
+        std::uint32_t offset;
+        /// @brief String length.
+        std::uint32_t size;
+    };
+
+    /// @brief Transition of a compiled calendar time zone in a snapshot.
+    struct SnapshotTransition {
+        /// @brief Time of the transition in seconds since the epoch.
+        std::int64_t at;
+        /// @brief UTC offset in seconds from the transition on.
+        std::int64_t offset;
+    };
+
+    /// @brief "URPCSNAP" read as a little-endian integer. Snapshots from machines with a different byte order
+    /// are rejected, because the magic number does not match.
+    constexpr std::uint64_t SNAPSHOT_MAGIC = 0x50414E5343505255;
+    /// @brief Version of the snapshot layout, has to be changed with every change of the structures below.
+    constexpr std::uint32_t SNAPSHOT_VERSION = 6;
+
+    /// @brief Beginning of a snapshot file, followed by an array of SnapshotEvent,
+    /// the dictionary (an array of SnapshotString), transitions of the time zone (an array of SnapshotTransition)
+    /// and the string section.
+    struct SnapshotHeader {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t event_count;
+        /// @brief Fingerprint of the calendar location, so that changing it in the config invalidates the snapshot.
+        std::uint64_t location;
+        /// @brief Fingerprint of the calendar data, compared with the fingerprint of the next download.
+        usos_rpc::icalendar::ContentFingerprint fingerprint;
+        /// @brief Beginning of the range of time the events were parsed for, in seconds since the epoch.
+        std::int64_t window_begin;
+        /// @brief End of the range of time the events were parsed for, in seconds since the epoch.
+        std::int64_t window_end;
+        /// @brief Fingerprint of everything after the header.
+        std::uint64_t checksum;
+        /// @brief Size of the string section.
+        std::uint64_t strings_size;
+        /// @brief Number of strings in the dictionary.
+        std::uint32_t string_count;
+        SnapshotString name;
+        SnapshotString product_id;
+        SnapshotString time_zone;
+        /// @brief Number of transitions of a time zone compiled from VTIMEZONE, 0 for database zones.
+        /// The first one only holds the offset before all others.
+        std::uint32_t transition_count;
+    };
+
+    /// @brief Single event in a snapshot, in the order of the event list.
+    /// Text fields are indices in the dictionary, like in usos_rpc::icalendar::EventRecord.
+    struct SnapshotEvent {
+        /// @brief Start in the calendar time zone, in seconds since the epoch.
+        std::int64_t start;
+        /// @brief End in the calendar time zone, in seconds since the epoch.
+        std::int64_t end;
+        std::uint32_t uid;
+        std::uint32_t subject;
+        std::uint32_t type;
+        std::uint32_t description;
+        std::uint32_t address;
+        std::uint32_t reserved = 0;
+    };
+
+    static_assert(std::is_trivially_copyable_v<SnapshotHeader> && sizeof(SnapshotHeader) % 8 == 0);
+    static_assert(std::is_trivially_copyable_v<SnapshotEvent> && sizeof(SnapshotEvent) % 8 == 0);
+    static_assert(std::is_trivially_copyable_v<SnapshotString> && sizeof(SnapshotString) == 8);
+    static_assert(std::is_trivially_copyable_v<SnapshotTransition> && sizeof(SnapshotTransition) == 16);
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Writes the calendar to a snapshot file. The file is replaced atomically,
+    /// so a snapshot is never left half-written.
+    /// @param calendar calendar to save
+    /// @param path snapshot file path
+    /// @param location fingerprint of the calendar location
+    /// @throws usos_rpc::Exception when writing the file fails
+    void save_snapshot(const Calendar& calendar, const std::filesystem::path& path, std::uint64_t location) {
+        std::string strings;
+        auto add = [&strings](std::string_view text) {
+            if (strings.size() + text.size() > std::numeric_limits<std::uint32_t>::max()) {
+                throw Exception(ExceptionType::IO, "Calendar is too large for a snapshot!");
+            }
+            SnapshotString result { .offset = static_cast<std::uint32_t>(strings.size()),
+                                    .size = static_cast<std::uint32_t>(text.size()) };
+            strings.append(text);
+            return result;
+        };
+
+        SnapshotHeader header {
+            .magic = SNAPSHOT_MAGIC,
+            .version = SNAPSHOT_VERSION,
+            .event_count = static_cast<std::uint32_t>(calendar.records().size()),
+            .location = location,
+            .fingerprint = calendar.fingerprint(),
+            .window_begin = calendar.window_begin().time_since_epoch().count(),
+            .window_end = calendar.window_end().time_since_epoch().count(),
+            .checksum = 0,
+            .strings_size = 0,
+            .string_count = static_cast<std::uint32_t>(calendar.strings().size()),
+            .name = add(calendar.name()),
+            .product_id = add(calendar.product_id()),
+            .time_zone = add(calendar.time_zone().name()),
+            .transition_count = 0,
+        };
+        std::vector<SnapshotEvent> events;
+        events.reserve(calendar.records().size());
+        for (const auto& record : calendar.records()) {
+            events.push_back({
+                .start = record.start.time_since_epoch().count(),
+                .end = record.end.time_since_epoch().count(),
+                .uid = record.uid,
+                .subject = record.subject,
+                .type = record.type,
+                .description = record.description,
+                .address = record.address,
+            });
+        }
+        std::vector<SnapshotString> dictionary;
+        dictionary.reserve(calendar.strings().size());
+        for (auto text : calendar.strings()) {
+            dictionary.push_back(add(text));
+        }
+        std::vector<SnapshotTransition> transitions;
+        if (const auto* offsets = calendar.time_zone().offsets()) {
+            transitions.push_back({ .at = 0, .offset = offsets->initial_offset().count() });
+            for (const auto& transition : offsets->transitions()) {
+                transitions.push_back({
+                    .at = transition.at.time_since_epoch().count(),
+                    .offset = transition.offset.count(),
+                });
+            }
+        }
+        header.strings_size = strings.size();
+        header.transition_count = static_cast<std::uint32_t>(transitions.size());
+
+        const auto events_size = events.size() * sizeof(SnapshotEvent);
+        const auto dictionary_size = dictionary.size() * sizeof(SnapshotString);
+        const auto transitions_size = transitions.size() * sizeof(SnapshotTransition);
+        const auto tables_size = events_size + dictionary_size + transitions_size;
+        std::string data(sizeof(SnapshotHeader) + tables_size + strings.size(), '\0');
+        auto* body = data.data() + sizeof(SnapshotHeader);
+        std::memcpy(body, events.data(), events_size);
+        std::memcpy(body + events_size, dictionary.data(), dictionary_size);
+        std::memcpy(body + events_size + dictionary_size, transitions.data(), transitions_size);
+        std::memcpy(body + tables_size, strings.data(), strings.size());
+        header.checksum = fingerprint(std::string_view(data).substr(sizeof(SnapshotHeader)));
+        std::memcpy(data.data(), &header, sizeof(SnapshotHeader));
+
+        auto temporary = path;
+        temporary += ".tmp";
+        write_file(temporary.string(), data);
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            throw Exception(ExceptionType::IO, "Cannot write to file ({})!", path.string());
+        }
+    }
+
+    /// @brief Loads a calendar from a snapshot file. The file is mapped into memory and used in place:
+    /// all strings of the calendar point into the mapping, only fixed-size event records are read.
+    /// @param path snapshot file path
+    /// @param location fingerprint of the current calendar location
+    /// @return loaded calendar or nullopt if the snapshot was made for another location
+    /// @throws usos_rpc::Exception when the snapshot cannot be read or is invalid
+    [[nodiscard]]
+    std::optional<Calendar> load_snapshot(const std::filesystem::path& path, std::uint64_t location) {
+        auto mapping = std::make_unique<MappedFile>(path.string());
+        auto data = mapping->contents();
+        auto invalid = [&path]() {
+            return Exception(ExceptionType::IO, "Invalid calendar snapshot ({})!", path.string());
+        };
+
+        // The mapping is page-aligned, so the header and the events can be used in place.
+        if (data.size() < sizeof(SnapshotHeader)) {
+            throw invalid();
+        }
+        const auto& header = *reinterpret_cast<const SnapshotHeader*>(data.data());
+        if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION) {
+            throw invalid();
+        }
+        if (header.location != location) {
+            return std::nullopt;
+        }
+        auto body = data.substr(sizeof(SnapshotHeader));
+        const auto events_size = std::uint64_t(header.event_count) * sizeof(SnapshotEvent);
+        const auto dictionary_size = std::uint64_t(header.string_count) * sizeof(SnapshotString);
+        const auto transitions_size = std::uint64_t(header.transition_count) * sizeof(SnapshotTransition);
+        const auto tables_size = events_size + dictionary_size + transitions_size;
+        if (tables_size > body.size() || body.size() - tables_size != header.strings_size
+            || fingerprint(body) != header.checksum) {
+            throw invalid();
+        }
+
+        auto strings = body.substr(tables_size);
+        auto get = [&strings, &invalid](SnapshotString text) {
+            if (text.offset > strings.size() || text.size > strings.size() - text.offset) {
+                throw invalid();
+            }
+            return strings.substr(text.offset, text.size);
+        };
+
+        TimeZone zone;
+        if (header.transition_count == 0) {
+            try {
+                zone = TimeZone(date::locate_zone(get(header.time_zone)));
+            } catch (const std::runtime_error&) {
+                throw invalid();
+            }
+        } else {
+            const auto* saved =
+                reinterpret_cast<const SnapshotTransition*>(body.data() + events_size + dictionary_size);
+            std::vector<ZoneTransition> transitions;
+            transitions.reserve(header.transition_count - 1);
+            for (std::size_t i = 1; i < header.transition_count; i++) {
+                transitions.push_back({
+                    .at = date::sys_seconds(std::chrono::seconds(saved[i].at)),
+                    .offset = std::chrono::seconds(saved[i].offset),
+                });
+            }
+            // Transitions have to be strictly increasing.
+            if (!std::ranges::is_sorted(transitions, std::ranges::less_equal(), &ZoneTransition::at)) {
+                throw invalid();
+            }
+            const std::chrono::seconds initial(saved[0].offset);
+            zone = TimeZone(get(header.time_zone), ZoneOffsets(initial, transitions));
+        }
+
+        auto arena = std::make_unique<Calendar::Arena>(
+            header.event_count * (sizeof(EventRecord) + sizeof(date::sys_seconds))
+            + header.string_count * sizeof(std::string_view) + 1024
+        );
+        const auto* dictionary = reinterpret_cast<const SnapshotString*>(body.data() + events_size);
+        arena->strings.reserve(header.string_count);
+        for (std::size_t i = 0; i < header.string_count; i++) {
+            arena->add_text(get(dictionary[i]));
+        }
+
+        auto check_id = [&header, &invalid](std::uint32_t id, bool required) {
+            if (id == NO_TEXT ? required : id >= header.string_count) {
+                throw invalid();
+            }
+            return id;
+        };
+        const auto* records = reinterpret_cast<const SnapshotEvent*>(body.data());
+        arena->records.reserve(header.event_count);
+        for (std::size_t i = 0; i < header.event_count; i++) {
+            const auto& record = records[i];
+            arena->records.push_back({
+                .start = date::local_seconds(std::chrono::seconds(record.start)),
+                .end = date::local_seconds(std::chrono::seconds(record.end)),
+                .utc_start = {},
+                .utc_end = {},
+                .uid = check_id(record.uid, true),
+                .subject = check_id(record.subject, true),
+                .type = check_id(record.type, false),
+                .description = check_id(record.description, false),
+                .address = check_id(record.address, record.description != NO_TEXT),
+            });
+        }
+
+        // Events were saved in order, which is required by the calendar.
+        const auto& texts = arena->strings;
+        if (!std::ranges::is_sorted(arena->records, {}, [&texts](const EventRecord& record) {
+                return std::tuple(record.start, record.end, texts[record.uid]);
+            })) {
+            throw invalid();
+        }
+
+        auto name = get(header.name);
+        auto product_id = get(header.product_id);
+        auto calendar_fingerprint = header.fingerprint;
+        auto window_begin = date::sys_seconds(std::chrono::seconds(header.window_begin));
+        auto window_end = date::sys_seconds(std::chrono::seconds(header.window_end));
+        arena->mapping = std::move(mapping);
+        return Calendar(
+            std::move(arena),
+            name,
+            product_id,
+            std::move(zone),
+            calendar_fingerprint,
+            window_begin,
+            window_end
+        );
+    }
+
+}
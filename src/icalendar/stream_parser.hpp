@@ -0,0 +1,318 @@
+/// @file
+/// @brief Incremental iCalendar parser for data arriving in chunks.
+
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../exceptions.hpp"
+#include "calendar.hpp"
+#include "fingerprint.hpp"
+#include "parser.hpp"
+#include "property.hpp"
+
+namespace {
+
+    /// @brief Finds the property name of a raw (still folded and escaped) content line without decoding it.
+    /// @param raw raw content line
+    /// @return property name or nullopt if the line is blank or its name is folded
+    [[nodiscard]]
+    std::optional<std::string_view> raw_property_name(std::string_view raw) {
+        auto name_end = raw.find_first_of(";:\r\n");
+        if (name_end == std::string_view::npos || raw[name_end] == '\r' || raw[name_end] == '\n') {
+            return std::nullopt;
+        }
+        return raw.substr(0, name_end);
+    }
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Parser fed with consecutive chunks of an iCalendar file, for example straight from the network.
+    /// Only the unfinished line and the current top-level component are buffered, every VEVENT is parsed
+    /// as soon as its last line arrives. DTSTAMP properties are skipped, because they change with every download.
+    class StreamParser {
+        /// @brief Memory arena of the calendar being built.
+        std::unique_ptr<Calendar::Arena> _arena;
+        /// @brief Previous version of the calendar to reuse events from, may be nullptr.
+        const Calendar* _previous;
+        /// @brief Parser settings.
+        ParseOptions _options;
+        /// @brief Events to keep, known together with the calendar time zone.
+        EventWindow _window;
+
+        /// @brief Raw text of lines which are not finished yet.
+        std::string _pending;
+        /// @brief Position in _pending from which to continue looking for line ends.
+        std::size_t _scan = 0;
+        /// @brief Raw text of the current VEVENT or VTIMEZONE.
+        std::string _event;
+        /// @brief Buffer for decoding single lines.
+        std::string _scratch;
+        /// @brief Decoded lines of the current line or component, reused so that parsing an event does not allocate.
+        std::vector<std::string_view> _lines;
+
+        /// @brief Current component nesting level, VCALENDAR itself is level 1.
+        int _depth = 0;
+        /// @brief True if the current top-level component is a VEVENT.
+        bool _in_event = false;
+        /// @brief True if the current top-level component is a VTIMEZONE.
+        bool _in_zone = false;
+        /// @brief True after END:VCALENDAR.
+        bool _ended = false;
+
+        /// @brief Calendar properties found so far.
+        CalendarProperties _properties;
+        /// @brief Time zones defined by VTIMEZONE components so far.
+        std::vector<TimeZone> _defined_zones;
+        /// @brief Calendar time zones, known after X-WR-TIMEZONE.
+        std::optional<CalendarZones> _zones;
+        /// @brief Decoded lines of events that ended before the calendar time zone was known.
+        std::vector<std::vector<std::string_view>> _deferred;
+        /// @brief Events parsed so far, in document order.
+        std::vector<Event> _events;
+        /// @brief True if at least one event could not be parsed.
+        bool _event_fail = false;
+        /// @brief Fingerprint of all raw text so far, except for DTSTAMP properties.
+        ContentHasher _hasher;
+
+        /// @brief Decodes a single raw line into a temporary buffer.
+        /// @param raw raw content line
+        /// @return decoded line, valid until the next call, empty if the line is blank
+        [[nodiscard]]
+        std::string_view decode_line(std::string_view raw) {
+            _scratch.assign(raw);
+            preprocess(_scratch, _lines);
+            return _lines.empty() ? std::string_view() : _lines.front();
+        }
+
+        /// @brief Splits buffered text into complete lines and processes them.
+        /// A line is complete when the first character of the next one is known not to be a fold.
+        /// @param at_end true if no more text will arrive
+        void process_lines(bool at_end) {
+            std::size_t line_start = 0;
+            while (true) {
+                auto line_end = _pending.find('\n', _scan);
+                if (line_end == std::string::npos || line_end + 1 == _pending.size()) {
+                    _scan = line_end == std::string::npos ? _pending.size() : line_end;
+                    break;
+                }
+                _scan = line_end + 1;
+                if (_pending[_scan] == ' ' || _pending[_scan] == '\t') {
+                    continue;
+                }
+                process_line(std::string_view(_pending).substr(line_start, _scan - line_start));
+                line_start = _scan;
+            }
+            if (at_end && line_start < _pending.size()) {
+                process_line(std::string_view(_pending).substr(line_start));
+                line_start = _pending.size();
+            }
+            _pending.erase(0, line_start);
+            _scan -= std::min(_scan, line_start);
+        }
+
+        /// @brief Processes a single complete line.
+        /// @param raw raw content line with its line break
+        /// @throws usos_rpc::Exception when the calendar structure is invalid
+        void process_line(std::string_view raw) {
+            std::string_view decoded;
+            auto name = raw_property_name(raw);
+            if (!name.has_value()) {
+                decoded = decode_line(raw);
+                if (decoded.empty()) {
+                    return;
+                }
+                name = split_content_line(decoded).name;
+            }
+            auto property = find_property(name.value());
+            if (property == Property::DTSTAMP) {
+                return;
+            }
+
+            std::string_view component;
+            if (property == Property::BEGIN || property == Property::END) {
+                // Component names are almost never folded or escaped, so decoding can be skipped.
+                component = raw.substr(std::min(name->size() + 1, raw.size()));
+                while (!component.empty() && std::isspace(static_cast<unsigned char>(component.back()))) {
+                    component.remove_suffix(1);
+                }
+                if (!decoded.empty() || component.find_first_of("\r\n\\") != std::string_view::npos) {
+                    component = split_content_line(decoded.empty() ? decode_line(raw) : decoded).value;
+                }
+            }
+
+            if (_ended || (_depth == 0 && (property != Property::BEGIN || component != "VCALENDAR"))) {
+                throw Exception(ExceptionType::ICALENDAR, "Invalid iCalendar file!");
+            } else if (_depth == 0) {
+                _depth = 1;
+            } else if (_depth == 1) {
+                if (property == Property::BEGIN) {
+                    _depth = 2;
+                    _in_event = component == "VEVENT";
+                    _in_zone = component == "VTIMEZONE";
+                    if (_in_event || _in_zone) {
+                        _event.assign(raw);
+                    }
+                } else if (property == Property::END) {
+                    _depth = 0;
+                    _ended = true;
+                } else if (property != Property::UNKNOWN) {
+                    auto& slot = _properties[static_cast<std::size_t>(property)];
+                    if (!slot.has_value()) {
+                        // Calendar properties are needed until the end, so they are kept in the arena.
+                        std::span<char> line(_arena->allocate_text(raw.size()), raw.size());
+                        std::copy(raw.begin(), raw.end(), line.begin());
+                        preprocess(line, _lines);
+                        slot = _lines.empty() ? std::string_view() : split_content_line(_lines.front()).value;
+                    }
+                }
+            } else {
+                if (_in_event || _in_zone) {
+                    _event.append(raw);
+                }
+                if (property == Property::BEGIN) {
+                    _depth++;
+                } else if (property == Property::END && --_depth == 1) {
+                    if (_in_event) {
+                        finish_event();
+                    } else if (_in_zone) {
+                        finish_zone();
+                    }
+                }
+            }
+        }
+
+        /// @brief Decodes the current VEVENT into the arena and parses it if the calendar time zone is known.
+        void finish_event() {
+            std::span<char> text(_arena->allocate_text(_event.size()), _event.size());
+            std::copy(_event.begin(), _event.end(), text.begin());
+            _event.clear();
+            _in_event = false;
+
+            if (resolve_zone()) {
+                preprocess(text, _lines);
+                parse_event_lines(_lines);
+            } else {
+                _deferred.push_back(preprocess(text));
+            }
+        }
+
+        /// @brief Compiles the current VTIMEZONE. Only zones defined before the first event
+        /// can be the calendar time zone, like in practically all calendars.
+        void finish_zone() {
+            preprocess(_event, _lines);
+            if (auto zone = compile_time_zone(_lines)) {
+                auto& defined = _zones.has_value() ? _zones->defined : _defined_zones;
+                defined.push_back(std::move(zone.value()));
+            }
+            _event.clear();
+            _in_zone = false;
+        }
+
+        /// @brief Parses decoded lines of a VEVENT and adds the event to the calendar.
+        /// @param lines decoded lines, from BEGIN:VEVENT to END:VEVENT
+        void parse_event_lines(const std::vector<std::string_view>& lines) {
+            try {
+                if (auto event = make_event({ lines.begin(), lines.end() - 1 }, _zones.value(), _previous, _window)) {
+                    _events.push_back(std::move(event.value()));
+                }
+            } catch (const Exception& err) {
+                _event_fail = true;
+            }
+        }
+
+        /// @brief Resolves the calendar time zone if it is not known yet.
+        /// @return true if the time zone is known
+        /// @throws usos_rpc::Exception when the time zone is unknown
+        bool resolve_zone() {
+            if (_zones.has_value()) {
+                return true;
+            }
+            const auto& timezone = _properties[static_cast<std::size_t>(Property::X_WR_TIMEZONE)];
+            if (!timezone.has_value()) {
+                return false;
+            }
+            _zones.emplace(timezone.value(), std::move(_defined_zones));
+            _window = EventWindow::from_utc(_options.window_begin, _options.window_end, _zones->calendar);
+            // Times of reused events are already converted to the time zone of the previous version.
+            if (_previous != nullptr && _previous->time_zone() != _zones->calendar) {
+                _previous = nullptr;
+            }
+            return true;
+        }
+
+    public:
+        /// @brief Creates a parser waiting for the first chunk.
+        /// @param previous previous version of the same calendar to reuse unchanged events from or nullptr
+        /// @param options parser settings, only the event window is used
+        explicit StreamParser(const Calendar* previous = nullptr, const ParseOptions& options = {}):
+        _arena(std::make_unique<Calendar::Arena>(64 * 1024)),
+        _previous(previous),
+        _options(options) {}
+
+        /// @brief Parses the next chunk of the file. Lines may be split between chunks at any point.
+        /// @param chunk next part of the text
+        /// @throws usos_rpc::Exception when the calendar structure is invalid
+        void feed(std::string_view chunk) {
+            _hasher.feed(chunk);
+            _pending.append(chunk);
+            process_lines(false);
+        }
+
+        /// @brief Returns the fingerprint of the raw text fed so far, like usos_rpc::icalendar::content_fingerprint().
+        /// @return content fingerprint
+        [[nodiscard]]
+        ContentFingerprint content_fingerprint() const {
+            return _hasher.finish();
+        }
+
+        /// @brief Parses the rest of the file and creates the calendar. The parser cannot be used afterwards.
+        /// @return parsed calendar data
+        /// @throws usos_rpc::Exception when parsing fails
+        [[nodiscard]]
+        Calendar finish() {
+            process_lines(true);
+            if (!_ended) {
+                throw Exception(ExceptionType::ICALENDAR, "Invalid iCalendar file!");
+            }
+
+            auto prodid = required_property(_properties, Property::PRODID);
+            auto calname = required_property(_properties, Property::X_WR_CALNAME);
+            if (!resolve_zone()) {
+                throw Exception(
+                    ExceptionType::ICALENDAR,
+                    "Missing property: {}",
+                    PROPERTY_NAMES[static_cast<std::size_t>(Property::X_WR_TIMEZONE)]
+                );
+            }
+            for (const auto& lines : _deferred) {
+                parse_event_lines(lines);
+            }
+            _deferred.clear();
+
+            if (_event_fail && _events.empty()) {
+                throw Exception(ExceptionType::ICALENDAR, "Could not parse events!");
+            }
+            _arena->store_events(_events);
+            return Calendar(
+                std::move(_arena),
+                calname,
+                prodid,
+                _zones->calendar,
+                windowed_fingerprint(_hasher.finish(), _options),
+                _options.window_begin,
+                _options.window_end
+            );
+        }
+    };
+
+}
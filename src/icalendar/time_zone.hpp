@@ -0,0 +1,137 @@
+/// @file
+/// @brief Time zones of calendars, defined by VTIMEZONE components or taken from the time zone database.
+
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../exceptions.hpp"
+#include "zone_offsets.hpp"
+
+#include "date/date.h"
+#include "date/tz.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Time zone of calendar timestamps. Zones defined by VTIMEZONE components are compiled into a table
+    /// of offsets and do not depend on the time zone database, other zones are located in it by name.
+    class TimeZone {
+        /// @brief Zone from the time zone database, nullptr for compiled zones.
+        const date::time_zone* _database_zone = nullptr;
+        /// @brief Name (TZID) of a compiled zone.
+        std::string _name;
+        /// @brief Offsets compiled from VTIMEZONE rules, shared by copies of the zone.
+        std::shared_ptr<const ZoneOffsets> _offsets;
+
+    public:
+        TimeZone() = default;
+
+        /// @brief Creates a zone from the time zone database.
+        /// @param zone database zone
+        explicit TimeZone(const date::time_zone* zone): _database_zone(zone) {}
+
+        /// @brief Creates a compiled zone.
+        /// @param name zone name (TZID)
+        /// @param offsets offsets compiled from VTIMEZONE rules
+        TimeZone(std::string_view name, ZoneOffsets offsets):
+        _name(name),
+        _offsets(std::make_shared<const ZoneOffsets>(std::move(offsets))) {}
+
+        /// @brief Locates a zone in the time zone database.
+        /// @param name zone name
+        /// @return found zone
+        /// @throws usos_rpc::Exception when there is no such zone
+        [[nodiscard]]
+        static TimeZone locate(std::string_view name) {
+            try {
+                return TimeZone(date::locate_zone(name));
+            } catch (const std::runtime_error&) {
+                throw Exception(ExceptionType::ICALENDAR, "Unknown time zone: {}", name);
+            }
+        }
+
+        /// @brief Returns the zone name.
+        /// @return zone name
+        [[nodiscard]]
+        std::string_view name() const {
+            return _database_zone != nullptr ? _database_zone->name() : std::string_view(_name);
+        }
+
+        /// @brief Returns the zone from the time zone database.
+        /// @return database zone or nullptr for compiled zones
+        [[nodiscard]]
+        const date::time_zone* database_zone() const {
+            return _database_zone;
+        }
+
+        /// @brief Returns offsets compiled from VTIMEZONE rules.
+        /// @return compiled offsets or nullptr for database zones
+        [[nodiscard]]
+        const ZoneOffsets* offsets() const {
+            return _offsets.get();
+        }
+
+        /// @brief Converts UTC time to local time of the zone.
+        /// @param time UTC time
+        /// @return local time
+        [[nodiscard]]
+        date::local_seconds to_local(date::sys_seconds time) const {
+            return _offsets != nullptr ? _offsets->to_local(time) : _database_zone->to_local(time);
+        }
+
+        /// @brief Converts local time of the zone to UTC, like date::choose::earliest.
+        /// @param time local time
+        /// @return UTC time
+        [[nodiscard]]
+        date::sys_seconds to_sys(date::local_seconds time) const {
+            return _offsets != nullptr ? _offsets->to_sys(time) : _database_zone->to_sys(time, date::choose::earliest);
+        }
+
+        /// @brief Checks whether both zones convert times in the same way.
+        /// @param other zone to compare
+        /// @return true if equal
+        bool operator==(const TimeZone& other) const {
+            if (_offsets == nullptr || other._offsets == nullptr) {
+                return _offsets == other._offsets && _database_zone == other._database_zone;
+            }
+            return _name == other._name && *_offsets == *other._offsets;
+        }
+    };
+
+    /// @brief Time zones needed to convert timestamps of a calendar.
+    struct CalendarZones {
+        /// @brief Zones defined by VTIMEZONE components of the calendar.
+        std::vector<TimeZone> defined;
+        /// @brief Calendar time zone, all event times are converted to it.
+        TimeZone calendar;
+
+        /// @brief Resolves the calendar time zone.
+        /// @param calendar_zone name of the calendar time zone (X-WR-TIMEZONE)
+        /// @param definitions zones defined in the calendar
+        /// @throws usos_rpc::Exception when the zone is unknown
+        CalendarZones(std::string_view calendar_zone, std::vector<TimeZone> definitions):
+        defined(std::move(definitions)),
+        calendar(find(calendar_zone)) {}
+
+        /// @brief Finds a zone by its name (TZID), first among the zones defined in the calendar,
+        /// then in the time zone database.
+        /// @param name zone name
+        /// @return found zone
+        /// @throws usos_rpc::Exception when the zone is unknown
+        [[nodiscard]]
+        TimeZone find(std::string_view name) const {
+            for (const auto& zone : defined) {
+                if (zone.name() == name) {
+                    return zone;
+                }
+            }
+            return TimeZone::locate(name);
+        }
+    };
+
+}
@@ -0,0 +1,103 @@
+/// @file
+/// @brief Allocation-free parser for iCalendar DATE and DATE-TIME values.
+
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+#include "time_zone.hpp"
+
+#include "date/date.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Parsed DATE or DATE-TIME value.
+    struct Timestamp {
+        /// @brief Wall clock time. For UTC values it is equal to the UTC time.
+        date::local_seconds time;
+        /// @brief True if the value had a trailing 'Z', meaning UTC.
+        bool utc = false;
+        /// @brief True for DATE values (whole days without time of day).
+        bool date_only = false;
+
+        /// @brief Converts the timestamp to a point in time.
+        /// @param tz time zone of non-UTC values
+        /// @return UTC time
+        [[nodiscard]]
+        date::sys_seconds to_sys(const TimeZone& tz) const {
+            if (utc) {
+                return date::sys_seconds(time.time_since_epoch());
+            }
+            return tz.to_sys(time);
+        }
+    };
+
+}
+
+namespace {
+
+    /// @brief Parses a fixed number of decimal digits.
+    /// @param text text to parse
+    /// @param position index of the first digit
+    /// @param count number of digits
+    /// @return parsed number or -1 if any of the characters is not a digit
+    constexpr int parse_digits(std::string_view text, std::size_t position, std::size_t count) {
+        int result = 0;
+        for (std::size_t i = position; i < position + count; i++) {
+            if (text[i] < '0' || text[i] > '9') {
+                return -1;
+            }
+            result = result * 10 + (text[i] - '0');
+        }
+        return result;
+    }
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Parses a DATE (YYYYMMDD) or DATE-TIME (YYYYMMDDTHHMMSS with an optional 'Z') value.
+    /// Does not use streams or locales and can be evaluated at compile time.
+    /// @param value property value
+    /// @return parsed timestamp or nullopt if the value is invalid
+    [[nodiscard]]
+    constexpr std::optional<Timestamp> parse_timestamp(std::string_view value) {
+        if (value.size() != 8 && value.size() != 15 && value.size() != 16) {
+            return std::nullopt;
+        }
+
+        const int year = parse_digits(value, 0, 4);
+        const int month = parse_digits(value, 4, 2);
+        const int day = parse_digits(value, 6, 2);
+        if (year < 0 || month < 0 || day < 0) {
+            return std::nullopt;
+        }
+        const date::year_month_day ymd { date::year(year), date::month(month), date::day(day) };
+        if (!ymd.ok()) {
+            return std::nullopt;
+        }
+
+        Timestamp result { .time = date::local_days(ymd) };
+        if (value.size() == 8) {
+            result.date_only = true;
+            return result;
+        }
+
+        if (value[8] != 'T' || (value.size() == 16 && value[15] != 'Z')) {
+            return std::nullopt;
+        }
+        const int hours = parse_digits(value, 9, 2);
+        const int minutes = parse_digits(value, 11, 2);
+        const int seconds = parse_digits(value, 13, 2);
+        // Seconds equal to 60 are allowed for leap seconds.
+        if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || seconds < 0 || seconds > 60) {
+            return std::nullopt;
+        }
+        result.time += std::chrono::hours(hours) + std::chrono::minutes(minutes) + std::chrono::seconds(seconds);
+        result.utc = value.size() == 16;
+        return result;
+    }
+
+}
@@ -0,0 +1,371 @@
+/// @file
+/// @brief Compilation of VTIMEZONE components into tables of UTC offsets.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "property.hpp"
+#include "time_zone.hpp"
+#include "timestamp.hpp"
+#include "zone_offsets.hpp"
+
+#include "date/date.h"
+
+namespace {
+
+    /// @brief First year expanded from recurrence rules, earlier onsets only determine the initial offset.
+    constexpr int FIRST_COMPILED_YEAR = 1970;
+    /// @brief Last year expanded from recurrence rules, later times keep the offset from the end of this year.
+    constexpr int LAST_COMPILED_YEAR = 2099;
+
+    /// @brief Names of weekdays in BYDAY rule parts, in the order of date::weekday encoding.
+    constexpr std::array<std::string_view, 7> WEEKDAY_NAMES { "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+
+    /// @brief Parses a decimal integer with an optional sign.
+    /// @param text text to parse
+    /// @return parsed number or nullopt if the text is not a number
+    [[nodiscard]]
+    std::optional<int> parse_integer(std::string_view text) {
+        if (text.starts_with('+')) {
+            text.remove_prefix(1);
+        }
+        int result = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), result);
+        if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    /// @brief Parses a UTC offset like +0100 or -043000 (a TZOFFSETFROM or TZOFFSETTO value).
+    /// @param value property value
+    /// @return parsed offset or nullopt if the value is invalid
+    [[nodiscard]]
+    std::optional<std::chrono::seconds> parse_utc_offset(std::string_view value) {
+        if ((value.size() != 5 && value.size() != 7) || (value[0] != '+' && value[0] != '-')) {
+            return std::nullopt;
+        }
+        const int hours = parse_digits(value, 1, 2);
+        const int minutes = parse_digits(value, 3, 2);
+        const int seconds = value.size() == 7 ? parse_digits(value, 5, 2) : 0;
+        if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || seconds < 0 || seconds > 59) {
+            return std::nullopt;
+        }
+        const auto offset = std::chrono::hours(hours) + std::chrono::minutes(minutes) + std::chrono::seconds(seconds);
+        return value[0] == '-' ? -offset : offset;
+    }
+
+    /// @brief Converts local time with a known UTC offset to UTC.
+    /// @param time local time
+    /// @param offset UTC offset
+    /// @return UTC time
+    [[nodiscard]]
+    date::sys_seconds with_offset(date::local_seconds time, std::chrono::seconds offset) {
+        return date::sys_seconds((time - offset).time_since_epoch());
+    }
+
+    /// @brief Yearly recurrence of a time zone observance, like FREQ=YEARLY;BYMONTH=3;BYDAY=-1SU.
+    struct YearlyRule {
+        /// @brief Month of the onset.
+        date::month month;
+        /// @brief Day of the month of the onset, or the first day to look for the weekday from when week is 0.
+        date::day day;
+        /// @brief Weekday of the onset, nullopt if the onset is on a fixed day of the month.
+        std::optional<date::weekday> weekday;
+        /// @brief Occurrence of the weekday in the month, negative when counted from its end.
+        int week = 0;
+        /// @brief Last possible onset.
+        std::optional<usos_rpc::icalendar::Timestamp> until;
+        /// @brief Number of onsets, including the first one.
+        std::optional<int> count;
+
+        /// @brief Finds the day of the onset in a year.
+        /// @param year year to check
+        /// @return onset day or nullopt if there is no such day in the year
+        [[nodiscard]]
+        std::optional<date::local_days> in_year(date::year year) const {
+            if (!weekday.has_value()) {
+                const date::year_month_day result = year / month / day;
+                return result.ok() ? std::optional(date::local_days(result)) : std::nullopt;
+            }
+            if (week > 0) {
+                const date::year_month_weekday result(year, month, (*weekday)[static_cast<unsigned>(week)]);
+                return result.ok() ? std::optional(date::local_days(result)) : std::nullopt;
+            }
+            if (week < 0) {
+                const date::year_month_weekday_last last(year, month, date::weekday_last(*weekday));
+                const auto result = date::local_days(last) - date::days(7 * (-week - 1));
+                return date::year_month_day(result).month() == month ? std::optional(result) : std::nullopt;
+            }
+            const date::year_month_day first = year / month / day;
+            if (!first.ok()) {
+                return std::nullopt;
+            }
+            const auto result = date::local_days(first);
+            return result + (*weekday - date::weekday(result));
+        }
+    };
+
+    /// @brief Parses a recurrence rule of an observance. Only yearly rules, which describe time zones,
+    /// are supported.
+    /// @param rule RRULE value
+    /// @param start start of the observance, which provides the month and the day when they are not given
+    /// @return parsed rule or nullopt if it is invalid or not supported
+    [[nodiscard]]
+    std::optional<YearlyRule> parse_yearly_rule(std::string_view rule, date::local_seconds start) {
+        const date::year_month_day start_date(date::floor<date::days>(start));
+        YearlyRule result {
+            .month = start_date.month(),
+            .day = start_date.day(),
+            .weekday = std::nullopt,
+            .week = 0,
+            .until = std::nullopt,
+            .count = std::nullopt,
+        };
+        bool yearly = false;
+        int month_days = 0;
+        while (!rule.empty()) {
+            auto part = rule.substr(0, rule.find(';'));
+            rule.remove_prefix(std::min(part.size() + 1, rule.size()));
+            auto equals = part.find('=');
+            if (equals == std::string_view::npos) {
+                return std::nullopt;
+            }
+            auto key = part.substr(0, equals);
+            auto value = part.substr(equals + 1);
+            if (key == "FREQ") {
+                yearly = value == "YEARLY";
+            } else if (key == "INTERVAL") {
+                if (parse_integer(value) != 1) {
+                    return std::nullopt;
+                }
+            } else if (key == "BYMONTH") {
+                auto month = parse_integer(value);
+                if (!month.has_value() || *month < 1 || *month > 12) {
+                    return std::nullopt;
+                }
+                result.month = date::month(static_cast<unsigned>(*month));
+            } else if (key == "BYDAY") {
+                if (value.size() < 2) {
+                    return std::nullopt;
+                }
+                auto name = std::ranges::find(WEEKDAY_NAMES, value.substr(value.size() - 2));
+                if (name == WEEKDAY_NAMES.end()) {
+                    return std::nullopt;
+                }
+                result.weekday = date::weekday(static_cast<unsigned>(name - WEEKDAY_NAMES.begin()));
+                if (value.size() > 2) {
+                    auto week = parse_integer(value.substr(0, value.size() - 2));
+                    if (!week.has_value() || *week == 0 || *week < -5 || *week > 5) {
+                        return std::nullopt;
+                    }
+                    result.week = *week;
+                }
+            } else if (key == "BYMONTHDAY") {
+                // Older rules select a weekday from a week of days, like BYDAY=SU;BYMONTHDAY=8,9,10,11,12,13,14.
+                int first = 31;
+                while (!value.empty()) {
+                    auto item = value.substr(0, value.find(','));
+                    value.remove_prefix(std::min(item.size() + 1, value.size()));
+                    auto day = parse_integer(item);
+                    if (!day.has_value() || *day < 1 || *day > 31) {
+                        return std::nullopt;
+                    }
+                    first = std::min(first, *day);
+                    month_days++;
+                }
+                result.day = date::day(static_cast<unsigned>(first));
+            } else if (key == "UNTIL") {
+                result.until = usos_rpc::icalendar::parse_timestamp(value);
+                if (!result.until.has_value()) {
+                    return std::nullopt;
+                }
+            } else if (key == "COUNT") {
+                result.count = parse_integer(value);
+                if (!result.count.has_value() || *result.count < 1) {
+                    return std::nullopt;
+                }
+            } else if (key != "WKST") {
+                return std::nullopt;
+            }
+        }
+
+        if (!yearly || (result.weekday.has_value() ? (result.week == 0) != (month_days > 0) : month_days > 1)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    /// @brief STANDARD or DAYLIGHT sub-component of a VTIMEZONE, with raw values of its properties.
+    struct Observance {
+        /// @brief First onset, in local time before the onset.
+        std::optional<usos_rpc::icalendar::Timestamp> start;
+        /// @brief UTC offset before the onsets.
+        std::optional<std::chrono::seconds> offset_from;
+        /// @brief UTC offset after the onsets.
+        std::optional<std::chrono::seconds> offset_to;
+        /// @brief Recurrence rule of the onsets.
+        std::optional<std::string_view> rule;
+        /// @brief Values of RDATE properties, lists of additional onsets.
+        std::vector<std::string_view> dates;
+    };
+
+    /// @brief Single onset of an observance.
+    struct Onset {
+        /// @brief Time of the onset in UTC.
+        date::sys_seconds at;
+        /// @brief UTC offset before the onset.
+        std::chrono::seconds offset_from;
+        /// @brief UTC offset after the onset.
+        std::chrono::seconds offset_to;
+    };
+
+    /// @brief Lists onsets of an observance, recurring ones up to LAST_COMPILED_YEAR.
+    /// @param observance observance to expand
+    /// @param onsets list to append the onsets to
+    /// @return false if the observance is invalid or uses unsupported rules
+    bool list_onsets(const Observance& observance, std::vector<Onset>& onsets) {
+        using usos_rpc::icalendar::parse_timestamp;
+        if (!observance.start.has_value() || !observance.offset_from.has_value() || !observance.offset_to.has_value()) {
+            return false;
+        }
+        const auto start = observance.start->time;
+        const auto from = observance.offset_from.value();
+        const auto to = observance.offset_to.value();
+        onsets.push_back({ .at = with_offset(start, from), .offset_from = from, .offset_to = to });
+
+        if (observance.rule.has_value()) {
+            auto rule = parse_yearly_rule(observance.rule.value(), start);
+            if (!rule.has_value()) {
+                return false;
+            }
+            const auto start_day = date::floor<date::days>(start);
+            const auto time_of_day = start - start_day;
+            auto year = date::year_month_day(start_day).year();
+            if (!rule->count.has_value()) {
+                // Onsets long before the compiled range do not matter.
+                year = std::max(year, date::year(FIRST_COMPILED_YEAR - 1));
+            }
+            int count = 1;
+            for (; year <= date::year(LAST_COMPILED_YEAR); year++) {
+                auto day = rule->in_year(year);
+                if (!day.has_value() || *day + time_of_day <= start) {
+                    continue;
+                }
+                const auto time = *day + time_of_day;
+                const auto& until = rule->until;
+                if (until.has_value()
+                    && (until->utc ? with_offset(time, from) > with_offset(until->time, {}) : time > until->time)) {
+                    break;
+                }
+                if (rule->count.has_value() && count++ >= *rule->count) {
+                    break;
+                }
+                onsets.push_back({ .at = with_offset(time, from), .offset_from = from, .offset_to = to });
+            }
+        }
+
+        for (auto dates : observance.dates) {
+            while (!dates.empty()) {
+                auto value = dates.substr(0, dates.find(','));
+                dates.remove_prefix(std::min(value.size() + 1, dates.size()));
+                auto date = parse_timestamp(value);
+                if (!date.has_value()) {
+                    return false;  // PERIOD values are not supported.
+                }
+                onsets.push_back({
+                    .at = with_offset(date->time, date->utc ? std::chrono::seconds(0) : from),
+                    .offset_from = from,
+                    .offset_to = to,
+                });
+            }
+        }
+        return true;
+    }
+
+}
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Compiles a VTIMEZONE component into a table of offsets. Recurrence rules are expanded
+    /// from 1970 to 2099, later times keep the last offset.
+    /// @param lines decoded lines of the component, from BEGIN:VTIMEZONE to END:VTIMEZONE
+    /// @return compiled zone or nullopt if the component is invalid or uses unsupported rules,
+    /// in which case the zone is located in the time zone database by its name
+    [[nodiscard]]
+    std::optional<TimeZone> compile_time_zone(std::span<const std::string_view> lines) {
+        if (lines.size() < 2) {
+            return std::nullopt;
+        }
+        std::string_view tzid;
+        std::vector<Onset> onsets;
+        std::optional<Observance> observance;
+        int depth = 0;
+        for (auto line : lines.subspan(1, lines.size() - 2)) {
+            auto content = split_content_line(line);
+            if (content.name == "BEGIN") {
+                if (depth++ == 0 && (content.value == "STANDARD" || content.value == "DAYLIGHT")) {
+                    observance.emplace();
+                }
+            } else if (content.name == "END") {
+                if (--depth == 0 && observance.has_value()) {
+                    if (!list_onsets(observance.value(), onsets)) {
+                        return std::nullopt;
+                    }
+                    observance.reset();
+                }
+            } else if (depth == 0) {
+                if (content.name == "TZID") {
+                    tzid = content.value;
+                }
+            } else if (depth == 1 && observance.has_value()) {
+                if (content.name == "DTSTART") {
+                    observance->start = parse_timestamp(content.value);
+                } else if (content.name == "TZOFFSETFROM") {
+                    observance->offset_from = parse_utc_offset(content.value);
+                } else if (content.name == "TZOFFSETTO") {
+                    observance->offset_to = parse_utc_offset(content.value);
+                } else if (content.name == "RRULE" && !observance->rule.has_value()) {
+                    observance->rule = content.value;
+                } else if (content.name == "RDATE") {
+                    observance->dates.push_back(content.value);
+                }
+            }
+        }
+        if (tzid.empty() || onsets.empty()) {
+            return std::nullopt;
+        }
+
+        std::ranges::sort(onsets, {}, &Onset::at);
+        // Of all onsets before the compiled range, only the last one matters: it gives the initial offset.
+        const date::sys_seconds range_begin = date::sys_days(date::year(FIRST_COMPILED_YEAR) / 1 / 1);
+        auto first = std::ranges::lower_bound(onsets, range_begin, {}, &Onset::at);
+        const auto initial = first == onsets.begin() ? first->offset_from : std::prev(first)->offset_to;
+
+        std::vector<ZoneTransition> transitions;
+        auto offset = initial;
+        for (auto onset = first; onset != onsets.end(); onset++) {
+            if (onset->offset_to == offset) {
+                continue;
+            }
+            // Required by the table, so that local times of consecutive periods stay in order.
+            if (!transitions.empty() && onset->at - transitions.back().at < date::days(2)) {
+                return std::nullopt;
+            }
+            transitions.push_back({ .at = onset->at, .offset = onset->offset_to });
+            offset = onset->offset_to;
+        }
+        return TimeZone(tzid, ZoneOffsets(initial, transitions));
+    }
+
+}
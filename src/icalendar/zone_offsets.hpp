@@ -0,0 +1,213 @@
+/// @file
+/// @brief Compact table of UTC offsets of a time zone, for fast conversions of local times.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "date/date.h"
+#include "date/tz.h"
+
+namespace usos_rpc::icalendar {
+
+    /// @brief Change of the UTC offset of a time zone.
+    struct ZoneTransition {
+        /// @brief Time of the change in UTC.
+        date::sys_seconds at;
+        /// @brief UTC offset from this time on.
+        std::chrono::seconds offset;
+
+        bool operator==(const ZoneTransition&) const = default;
+    };
+
+    /// @brief UTC offsets of a time zone, either taken from the time zone database for a limited range of time
+    /// (usually a single semester), or compiled from VTIMEZONE rules for all time.
+    /// The period in effect at the beginning of every year is indexed, so a conversion starts at the right year
+    /// and takes a comparison or two, instead of a lookup in the full rules of the time zone.
+    class ZoneOffsets {
+        /// @brief Time interval with a constant UTC offset.
+        struct Period {
+            /// @brief Beginning of the period in UTC.
+            date::sys_seconds begin;
+            /// @brief Beginning of the period in local time.
+            date::local_seconds local_begin;
+            /// @brief End of the period in local time, increasing from period to period.
+            date::local_seconds local_end;
+            /// @brief UTC offset during the period.
+            std::chrono::seconds offset;
+
+            bool operator==(const Period&) const = default;
+        };
+
+        /// @brief Time zone of the table, nullptr for tables compiled from VTIMEZONE rules.
+        const date::time_zone* _time_zone = nullptr;
+        /// @brief Consecutive periods covering the whole range, empty if there is no time zone.
+        std::vector<Period> _periods;
+        /// @brief End of the last period in UTC.
+        date::sys_seconds _end;
+        /// @brief First indexed year.
+        date::year _first_year { 0 };
+        /// @brief Beginning of the first and the last indexed year in local time.
+        date::local_seconds _index_begin, _index_end;
+        /// @brief Index of the period in effect at the beginning of every year, starting with _first_year.
+        std::vector<std::uint32_t> _year_periods;
+
+        /// @brief Indexes the years between the first and the last transition.
+        void index_years() {
+            if (_periods.size() < 2) {
+                return;
+            }
+            auto year = date::year_month_day(date::floor<date::days>(_periods.front().local_end)).year();
+            const auto last = date::year_month_day(date::floor<date::days>(_periods.back().local_begin)).year();
+            _first_year = year;
+            _index_begin = date::local_days(year / date::month(1) / 1);
+            _index_end = date::local_days(last / date::month(1) / 1);
+            std::uint32_t period = 0;
+            for (; year <= last; year++) {
+                const date::local_seconds year_begin = date::local_days(year / date::month(1) / 1);
+                while (_periods[period].local_end <= year_begin) {
+                    period++;
+                }
+                _year_periods.push_back(period);
+            }
+        }
+
+        /// @brief Finds a period in effect not later than the given local time, as close to it as the index allows.
+        /// @param time local time
+        /// @return period index
+        [[nodiscard]]
+        std::size_t first_candidate(date::local_seconds time) const {
+            if (_year_periods.empty() || time < _index_begin) {
+                return 0;
+            }
+            if (time >= _index_end) {
+                return _year_periods.back();
+            }
+            auto year = date::year_month_day(date::floor<date::days>(time)).year();
+            return _year_periods[static_cast<std::size_t>((year - _first_year).count())];
+        }
+
+    public:
+        ZoneOffsets() = default;
+
+        /// @brief Creates a table of offsets covering the given range of local times.
+        /// @param tz time zone
+        /// @param first earliest local time that will be converted
+        /// @param last latest local time that will be converted
+        ZoneOffsets(const date::time_zone* tz, date::local_seconds first, date::local_seconds last): _time_zone(tz) {
+            if (tz == nullptr || last < first) {
+                return;
+            }
+            // Offsets are smaller than a day, so local times map to UTC times within these bounds.
+            const auto day = date::days(1);
+            auto time = date::sys_seconds(first.time_since_epoch()) - day;
+            const auto until = date::sys_seconds(last.time_since_epoch()) + day;
+            while (true) {
+                auto info = tz->get_info(time);
+                _periods.push_back({
+                    .begin = info.begin,
+                    .local_begin = date::local_seconds((info.begin + info.offset).time_since_epoch()),
+                    .local_end = date::local_seconds((info.end + info.offset).time_since_epoch()),
+                    .offset = info.offset,
+                });
+                if (info.end > until) {
+                    _end = info.end;
+                    break;
+                }
+                time = info.end;
+            }
+            index_years();
+        }
+
+        /// @brief Creates a table covering all time from compiled transitions.
+        /// @param initial UTC offset before the first transition
+        /// @param transitions transitions sorted by time, at least two days apart
+        ZoneOffsets(std::chrono::seconds initial, std::span<const ZoneTransition> transitions):
+        _end(date::sys_seconds::max()) {
+            _periods.reserve(transitions.size() + 1);
+            _periods.push_back({
+                .begin = date::sys_seconds::min(),
+                .local_begin = date::local_seconds::min(),
+                .local_end = {},
+                .offset = initial,
+            });
+            for (const auto& transition : transitions) {
+                auto& previous = _periods.back();
+                previous.local_end = date::local_seconds((transition.at + previous.offset).time_since_epoch());
+                _periods.push_back({
+                    .begin = transition.at,
+                    .local_begin = date::local_seconds((transition.at + transition.offset).time_since_epoch()),
+                    .local_end = {},
+                    .offset = transition.offset,
+                });
+            }
+            _periods.back().local_end = date::local_seconds::max();
+            index_years();
+        }
+
+        /// @brief Converts local time to UTC, choosing the earlier time when the local time is ambiguous,
+        /// and the time of the transition when it does not exist, like date::choose::earliest.
+        /// @param time local time
+        /// @return UTC time
+        [[nodiscard]]
+        date::sys_seconds to_sys(date::local_seconds time) const {
+            auto period = _periods.begin() + static_cast<std::ptrdiff_t>(first_candidate(time));
+            while (period != _periods.end() && period->local_end <= time) {
+                period++;
+            }
+            if (period == _periods.end() || (period == _periods.begin() && time < period->local_begin)) {
+                // Outside of the table.
+                return _time_zone->to_sys(time, date::choose::earliest);
+            }
+            if (time < period->local_begin) {
+                return period->begin;  // Skipped by a transition.
+            }
+            return date::sys_seconds((time - period->offset).time_since_epoch());
+        }
+
+        /// @brief Converts UTC time to local time.
+        /// @param time UTC time
+        /// @return local time
+        [[nodiscard]]
+        date::local_seconds to_local(date::sys_seconds time) const {
+            if (_periods.empty() || time < _periods.front().begin || time >= _end) {
+                return _time_zone->to_local(time);
+            }
+            // Local and UTC years differ by less than a day, so the indexed period is at most one off.
+            auto period = first_candidate(date::local_seconds(time.time_since_epoch()));
+            while (period > 0 && time < _periods[period].begin) {
+                period--;
+            }
+            while (period + 1 < _periods.size() && _periods[period + 1].begin <= time) {
+                period++;
+            }
+            return date::local_seconds((time + _periods[period].offset).time_since_epoch());
+        }
+
+        /// @brief Returns the UTC offset before the first transition of a compiled table.
+        /// @return initial offset
+        [[nodiscard]]
+        std::chrono::seconds initial_offset() const {
+            return _periods.empty() ? std::chrono::seconds(0) : _periods.front().offset;
+        }
+
+        /// @brief Returns the transitions of a compiled table, which recreate it with the initial offset.
+        /// @return transitions in order
+        [[nodiscard]]
+        std::vector<ZoneTransition> transitions() const {
+            std::vector<ZoneTransition> result;
+            for (std::size_t i = 1; i < _periods.size(); i++) {
+                result.push_back({ .at = _periods[i].begin, .offset = _periods[i].offset });
+            }
+            return result;
+        }
+
+        bool operator==(const ZoneOffsets&) const = default;
+    };
+
+}
@@ -5,6 +5,7 @@
 
 #include <cstdlib>
 #include <filesystem>
+#include <mutex>
 #include <utility>
 
 #include "exceptions.hpp"
@@ -22,6 +23,9 @@ namespace {
     /// @brief File to log all console output to, or a null pointer.
     std::unique_ptr<std::ofstream> log_file = nullptr;
 
+    /// @brief Guards output streams, as exceptions can be logged from parser threads.
+    std::mutex log_mutex;
+
 }
 
 bool usos_rpc::should_show_colored_output() {
@@ -44,6 +48,7 @@ void usos_rpc::initialize_logging() {
 
 void usos_rpc::log(std::ostream& stream, const std::string& to_print) {
     const auto stripped = std::regex_replace(to_print, ANSI_COLOR_CODES, "");
+    std::lock_guard lock(log_mutex);
 
     if (usos_rpc::should_show_colored_output()) {
         stream << to_print;
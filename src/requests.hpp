@@ -3,6 +3,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -12,22 +22,114 @@
 #include "utilities.hpp"
 
 #include "curl/curl.h"
+#include "fmt/format.h"
+
+namespace usos_rpc {
+
+    /// @brief Validators of an HTTP response. Sent back with the next request, they let the server answer
+    /// with 304 Not Modified instead of sending the same body again.
+    struct HttpValidators {
+        /// @brief Value of the ETag header, empty if there was none.
+        std::string etag;
+        /// @brief Value of the Last-Modified header, empty if there was none.
+        std::string last_modified;
+
+        /// @brief Checks whether the response had any validators.
+        /// @return true if there are none
+        [[nodiscard]]
+        bool empty() const {
+            return etag.empty() && last_modified.empty();
+        }
+    };
+
+}
 
 namespace {
 
+    /// @brief Whether all HTTP transfers should be aborted, lock-free so that it can be set by signal handlers.
+    std::atomic<bool> requests_cancelled = false;
+    static_assert(std::atomic<bool>::is_always_lock_free);
+
+    /// @brief Receiver of the response data for libcurl_callback().
+    struct ResponseConsumer {
+        /// @brief Function called with every chunk of the response.
+        const std::function<void(std::string_view)>& consume;
+        /// @brief Exception thrown by the function, rethrown after the transfer.
+        std::exception_ptr error;
+        /// @brief libcurl easy handle of the transfer, for checking the response status.
+        CURL* handle;
+        /// @brief Whether the body has been refused, because the response status is not 2xx.
+        bool rejected = false;
+    };
+
+    /// @brief Checks whether an HTTP response status means success.
+    /// @param status response status code
+    /// @return true for 2xx statuses
+    [[nodiscard]]
+    bool is_successful_status(long status) {
+        return status >= 200 && status < 300;
+    }
+
     /// @brief Internal callback for libcurl's CURLOPT_WRITEFUNCTION.
     /// @see https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
     /// @param buffer new data to handle
     /// @param size sizeof(char)
     /// @param nmemb length of the buffer
-    /// @param userp pointer to user data, in this case - std::string
-    /// @return the value of nmemb, signifying no error
+    /// @param userp pointer to user data, in this case - ResponseConsumer
+    /// @return the value of nmemb, signifying no error, or 0 if the consumer has thrown an exception
+    /// or the response is an error page
     std::size_t libcurl_callback(const char* buffer, std::size_t size, std::size_t nmemb, void* userp) {
         size *= nmemb;
 
-        auto str = (std::string*) userp;
-        str->append(buffer, size);
+        auto consumer = (ResponseConsumer*) userp;
+        // Bodies of error responses never reach the consumer.
+        long status = 0;
+        curl_easy_getinfo(consumer->handle, CURLINFO_RESPONSE_CODE, &status);
+        if (!is_successful_status(status)) {
+            consumer->rejected = true;
+            return 0;
+        }
+        try {
+            consumer->consume(std::string_view(buffer, size));
+        } catch (...) {
+            // Exceptions cannot pass through libcurl, so the transfer is aborted instead.
+            consumer->error = std::current_exception();
+            return 0;
+        }
+
+        return size;
+    }
 
+    /// @brief Internal callback for libcurl's CURLOPT_HEADERFUNCTION, collects response validators.
+    /// @see https://curl.se/libcurl/c/CURLOPT_HEADERFUNCTION.html
+    /// @param buffer single header line
+    /// @param size sizeof(char)
+    /// @param nitems length of the buffer
+    /// @param userp pointer to user data, in this case - usos_rpc::HttpValidators
+    /// @return the value of nitems, signifying no error
+    std::size_t libcurl_header_callback(const char* buffer, std::size_t size, std::size_t nitems, void* userp) {
+        size *= nitems;
+
+        auto validators = (usos_rpc::HttpValidators*) userp;
+        std::string_view line(buffer, size);
+        if (line.starts_with("HTTP/")) {
+            *validators = {};  // Headers of redirect responses do not describe the final one.
+            return size;
+        }
+        auto colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            return size;
+        }
+        auto is_name = [name = line.substr(0, colon)](std::string_view expected) {
+            return std::ranges::equal(name, expected, [](unsigned char first, unsigned char second) {
+                return std::tolower(first) == std::tolower(second);
+            });
+        };
+        if (is_name("ETag")) {
+            validators->etag = usos_rpc::strip(line.substr(colon + 1));
+        } else if (is_name("Last-Modified")) {
+            validators->last_modified = usos_rpc::strip(line.substr(colon + 1));
+        }
         return size;
     }
 
@@ -35,52 +137,364 @@ namespace {
 
 namespace usos_rpc {
 
+    /// @brief Aborts all HTTP transfers in flight and all future ones, e.g. when the program is terminating.
+    /// Safe to call from signal handlers.
+    void cancel_requests() {
+        requests_cancelled = true;
+    }
+
+    /// @brief Limits of every HTTP request, so that a stalled server cannot hang the program.
+    /// Zero disables a limit.
+    struct HttpLimits {
+        /// @brief Maximal time of connecting to the host.
+        std::chrono::seconds connect_timeout { 10 };
+        /// @brief Maximal time of the whole request.
+        std::chrono::seconds total_timeout { 120 };
+        /// @brief Transfer speed (in bytes per second) below which the request is aborted after low_speed_time.
+        std::int64_t low_speed_limit = 100;
+        /// @brief How long the transfer may stay below low_speed_limit.
+        std::chrono::seconds low_speed_time { 30 };
+    };
+
+    /// @brief Durations of the phases of an HTTP request, each measured from the start of the request.
+    struct HttpTimings {
+        /// @brief Until the host name was resolved.
+        std::chrono::microseconds name_lookup { 0 };
+        /// @brief Until the connection to the host was established.
+        std::chrono::microseconds connect { 0 };
+        /// @brief Until the TLS handshake was completed, 0 for plain HTTP.
+        std::chrono::microseconds tls_handshake { 0 };
+        /// @brief Until the first byte of the response arrived.
+        std::chrono::microseconds first_byte { 0 };
+        /// @brief Until the whole response arrived.
+        std::chrono::microseconds total { 0 };
+
+        /// @brief Timings formatting support for fmt.
+        /// @param timings timings to format
+        /// @return formatted string
+        friend auto format_as(const HttpTimings& timings) {
+            auto ms = [](std::chrono::microseconds duration) {
+                return std::chrono::duration<double, std::milli>(duration).count();
+            };
+            return fmt::format(
+                "DNS {:.1f} ms, connect {:.1f} ms, TLS {:.1f} ms, first byte {:.1f} ms, total {:.1f} ms",
+                ms(timings.name_lookup),
+                ms(timings.connect),
+                ms(timings.tls_handshake),
+                ms(timings.first_byte),
+                ms(timings.total)
+            );
+        }
+    };
+
+    /// @brief Event loop of HTTP transfers, driven by a libcurl multi handle. It checks for cancelled requests
+    /// every few milliseconds, and can be woken up and stopped from any other thread at any moment.
+    class HttpMulti {
+        /// @brief Longest wait for socket activity, which bounds the delay of cancelling requests.
+        static constexpr int POLL_TIMEOUT_MS = 20;
+
+        /// @brief libcurl multi handle.
+        CURLM* _handle;
+        /// @brief Whether transfers have been stopped for good.
+        std::atomic<bool> _stopped = false;
+
+    public:
+        /// @brief Creates an event loop without any transfers.
+        /// @throws usos_rpc::Exception when libcurl cannot be initialized
+        HttpMulti(): _handle(curl_multi_init()) {
+            if (!_handle) {
+                throw Exception(ExceptionType::CURL, "Failed to initialize Curl!");
+            }
+        }
+
+        HttpMulti(const HttpMulti&) = delete;
+        HttpMulti& operator=(const HttpMulti&) = delete;
+
+        ~HttpMulti() {
+            curl_multi_cleanup(_handle);
+        }
+
+        /// @brief Performs a transfer of an easy handle, waiting for socket activity between its steps.
+        /// @param easy configured easy handle
+        /// @return result of the transfer, CURLE_ABORTED_BY_CALLBACK if it has been stopped or cancelled
+        CURLcode perform(CURL* easy) {
+            if (_stopped || requests_cancelled) {
+                return CURLE_ABORTED_BY_CALLBACK;
+            }
+            if (curl_multi_add_handle(_handle, easy) != CURLM_OK) {
+                return CURLE_FAILED_INIT;
+            }
+            auto result = CURLE_ABORTED_BY_CALLBACK;
+            bool done = false;
+            while (!done && !_stopped && !requests_cancelled) {
+                int running = 0;
+                if (curl_multi_perform(_handle, &running) != CURLM_OK) {
+                    result = CURLE_FAILED_INIT;
+                    break;
+                }
+                int queued = 0;
+                while (auto* message = curl_multi_info_read(_handle, &queued)) {
+                    if (message->msg == CURLMSG_DONE && message->easy_handle == easy) {
+                        result = message->data.result;
+                        done = true;
+                    }
+                }
+                if (!done) {
+                    // cancel_requests() only sets a flag, as it has to be safe to call from signal handlers,
+                    // so the flag is checked after every short wait instead of waking the loop up.
+                    curl_multi_poll(_handle, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+                }
+            }
+            curl_multi_remove_handle(_handle, easy);
+            return result;
+        }
+
+        /// @brief Aborts the current transfer and all future ones. Can be called from any thread.
+        void stop() {
+            _stopped = true;
+            curl_multi_wakeup(_handle);
+        }
+    };
+
+    /// @brief Long-lived HTTP client, which keeps its own connection open between requests. Resolved host names
+    /// and TLS sessions are also shared with all other clients, so their requests to the same host skip the DNS
+    /// lookup and most of the TLS handshake. Responses are compressed and sent over HTTP/2 when libcurl
+    /// and the server support it. A single client cannot be used by many threads at once, but different clients can.
+    class HttpClient {
+        /// @brief Data shared by all clients, with locks for clients used on different threads.
+        class Share {
+            /// @brief libcurl share handle.
+            CURLSH* _handle;
+            /// @brief Locks of the shared data, by curl_lock_data.
+            std::array<std::mutex, CURL_LOCK_DATA_LAST> _locks;
+
+            /// @brief Internal callback for libcurl's CURLSHOPT_LOCKFUNC.
+            static void lock(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+                static_cast<Share*>(userptr)->_locks[data].lock();
+            }
+
+            /// @brief Internal callback for libcurl's CURLSHOPT_UNLOCKFUNC.
+            static void unlock(CURL*, curl_lock_data data, void* userptr) {
+                static_cast<Share*>(userptr)->_locks[data].unlock();
+            }
+
+        public:
+            Share(): _handle(curl_share_init()) {
+                if (!_handle) {
+                    return;  // Clients work without sharing as well.
+                }
+                curl_share_setopt(_handle, CURLSHOPT_LOCKFUNC, lock);
+                curl_share_setopt(_handle, CURLSHOPT_UNLOCKFUNC, unlock);
+                curl_share_setopt(_handle, CURLSHOPT_USERDATA, this);
+                curl_share_setopt(_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+                curl_share_setopt(_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+                // Connections are not shared, as libcurl does not support a shared connection cache
+                // for transfers running on different threads at once.
+            }
+
+            Share(const Share&) = delete;
+            Share& operator=(const Share&) = delete;
+
+            ~Share() {
+                curl_share_cleanup(_handle);
+            }
+
+            /// @brief Returns the share handle common for the whole program. Created on first use,
+            /// which also initializes libcurl, so it should happen on the main thread.
+            /// @return share handle or nullptr if it could not be created
+            static CURLSH* get() {
+                static Share share;
+                return share._handle;
+            }
+        };
+
+        /// @brief libcurl easy handle, reused for all requests.
+        CURL* _handle;
+        /// @brief Event loop of requests which block the calling thread, which also keeps their connection open.
+        HttpMulti _multi;
+        /// @brief Timings of the last request.
+        HttpTimings _timings;
+
+    public:
+        /// @brief Creates a client with options common for all requests.
+        /// @param limits limits of every request
+        /// @throws usos_rpc::Exception when libcurl cannot be initialized
+        explicit HttpClient(const HttpLimits& limits = {}): _handle(nullptr) {
+            auto* share = Share::get();
+            _handle = curl_easy_init();
+            if (!_handle) {
+                throw Exception(ExceptionType::CURL, "Failed to initialize Curl!");
+            }
+            curl_easy_setopt(_handle, CURLOPT_SHARE, share);
+            curl_easy_setopt(_handle, CURLOPT_USERAGENT, USER_AGENT);
+            curl_easy_setopt(_handle, CURLOPT_WRITEFUNCTION, libcurl_callback);
+            curl_easy_setopt(_handle, CURLOPT_HEADERFUNCTION, libcurl_header_callback);
+            curl_easy_setopt(_handle, CURLOPT_FOLLOWLOCATION, true);
+            auto milliseconds = [](std::chrono::seconds duration) {
+                return static_cast<long>(std::chrono::milliseconds(duration).count());
+            };
+            curl_easy_setopt(_handle, CURLOPT_CONNECTTIMEOUT_MS, milliseconds(limits.connect_timeout));
+            curl_easy_setopt(_handle, CURLOPT_TIMEOUT_MS, milliseconds(limits.total_timeout));
+            curl_easy_setopt(_handle, CURLOPT_LOW_SPEED_LIMIT, static_cast<long>(limits.low_speed_limit));
+            curl_easy_setopt(_handle, CURLOPT_LOW_SPEED_TIME, static_cast<long>(limits.low_speed_time.count()));
+            // An empty string means all encodings supported by libcurl, none if it was built without zlib.
+            curl_easy_setopt(_handle, CURLOPT_ACCEPT_ENCODING, "");
+            if (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2) {
+                curl_easy_setopt(_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            }
+        }
+
+        HttpClient(const HttpClient&) = delete;
+        HttpClient& operator=(const HttpClient&) = delete;
+
+        ~HttpClient() {
+            curl_easy_cleanup(_handle);
+        }
+
+        /// @brief Performs a conditional HTTP GET request, passing the response to the consumer chunk by chunk
+        /// as it arrives. The request carries the validators of a cached response (If-None-Match,
+        /// If-Modified-Since), so that the server can skip sending the body if it has not changed.
+        /// @param url URL of the request
+        /// @param consumer function called with every chunk of the (decompressed) response data
+        /// @param validators validators of the cached response, replaced with the validators of the new response
+        /// @param multi event loop to perform the request on, nullptr to block the calling thread until it is done
+        /// @return false if the server responded with 304 Not Modified, in which case nothing has been consumed
+        /// @throws usos_rpc::Exception when the request or libcurl fails, or the response status is not 2xx or 304
+        /// @throws anything thrown by the consumer, after aborting the request
+        bool get(
+            const char* url,
+            const std::function<void(std::string_view)>& consumer,
+            HttpValidators& validators,
+            HttpMulti* multi = nullptr
+        ) {
+            curl_slist* headers = nullptr;
+            if (!validators.etag.empty()) {
+                auto header = fmt::format("If-None-Match: {}", validators.etag);
+                headers = curl_slist_append(headers, header.c_str());
+            }
+            if (!validators.last_modified.empty()) {
+                auto header = fmt::format("If-Modified-Since: {}", validators.last_modified);
+                headers = curl_slist_append(headers, header.c_str());
+            }
+
+            ResponseConsumer response { .consume = consumer, .error = nullptr, .handle = _handle, .rejected = false };
+            HttpValidators received;
+            curl_easy_setopt(_handle, CURLOPT_URL, url);
+            curl_easy_setopt(_handle, CURLOPT_WRITEDATA, &response);
+            curl_easy_setopt(_handle, CURLOPT_HEADERDATA, &received);
+            curl_easy_setopt(_handle, CURLOPT_HTTPHEADER, headers);
+            // Even blocking requests run on an event loop, so that they are cancelled within milliseconds.
+            auto success = (multi != nullptr ? *multi : _multi).perform(_handle);
+            long status = 0;
+            curl_easy_getinfo(_handle, CURLINFO_RESPONSE_CODE, &status);
+            auto time = [this](CURLINFO info) {
+                curl_off_t microseconds = 0;
+                curl_easy_getinfo(_handle, info, &microseconds);
+                return std::chrono::microseconds(microseconds);
+            };
+            _timings = {
+                .name_lookup = time(CURLINFO_NAMELOOKUP_TIME_T),
+                .connect = time(CURLINFO_CONNECT_TIME_T),
+                .tls_handshake = time(CURLINFO_APPCONNECT_TIME_T),
+                .first_byte = time(CURLINFO_STARTTRANSFER_TIME_T),
+                .total = time(CURLINFO_TOTAL_TIME_T),
+            };
+
+            // Nothing may point to the local variables during the next request.
+            curl_easy_setopt(_handle, CURLOPT_HTTPHEADER, nullptr);
+            curl_slist_free_all(headers);
+            if (response.error) {
+                std::rethrow_exception(response.error);
+            }
+            if (success == CURLE_ABORTED_BY_CALLBACK && requests_cancelled) {
+                throw Exception(ExceptionType::CURL, "Request has been cancelled!");
+            }
+            if (response.rejected || (success == 0 && status != 304 && !is_successful_status(status))) {
+                throw Exception(ExceptionType::CURL, "Request failed with HTTP status {}!", status);
+            }
+            if (success != 0) {
+                throw Exception(ExceptionType::CURL, "Request failed: {}", curl_easy_strerror(success));
+            }
+            if (status == 304) {
+                return false;
+            }
+            validators = std::move(received);
+            return true;
+        }
+
+        /// @brief Returns durations of the phases of the last request. Phases that were skipped
+        /// thanks to a reused connection take no time.
+        /// @return timings of the last request
+        [[nodiscard]]
+        const HttpTimings& last_timings() const {
+            return _timings;
+        }
+    };
+
+    /// @brief Performs a conditional HTTP GET request with a temporary client, see usos_rpc::HttpClient::get().
+    /// @param url URL of the request
+    /// @param consumer function called with every chunk of the response data
+    /// @param validators validators of the cached response, replaced with the validators of the new response
+    /// @return false if the server responded with 304 Not Modified, in which case nothing has been consumed
+    /// @throws usos_rpc::Exception when the request or libcurl fails
+    /// @throws anything thrown by the consumer, after aborting the request
+    bool http_get(const char* url, const std::function<void(std::string_view)>& consumer, HttpValidators& validators) {
+        HttpClient client;
+        return client.get(url, consumer, validators);
+    }
+
+    /// @brief Performs an HTTP GET request, passing the response to the consumer chunk by chunk as it arrives.
+    /// @param url URL of the request
+    /// @param consumer function called with every chunk of the response data
+    /// @throws usos_rpc::Exception when the request or libcurl fails
+    /// @throws anything thrown by the consumer, after aborting the request
+    void http_get(const char* url, const std::function<void(std::string_view)>& consumer) {
+        HttpValidators validators;  // Without validators the server always sends the body.
+        http_get(url, consumer, validators);
+    }
+
     /// @brief Performs a simple HTTP GET request.
     /// @param url URL of the request
     /// @return response data
     /// @throws usos_rpc::Exception when the request or libcurl fails
     std::string http_get(const char* url) {
-        auto handle = curl_easy_init();
-        if (!handle) {
-            throw Exception(ExceptionType::CURL, "Failed to initialize Curl!");
-        }
-
         std::string response;
-        curl_easy_setopt(handle, CURLOPT_URL, url);
-        curl_easy_setopt(handle, CURLOPT_USERAGENT, USER_AGENT);
-        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, libcurl_callback);
-        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response);
-        curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, true);
-        auto success = curl_easy_perform(handle);
-
-        curl_easy_cleanup(handle);
-        if (success != 0) {
-            throw Exception(ExceptionType::CURL, "Request failed: {}", curl_easy_strerror(success));
-        }
+        http_get(url, [&response](std::string_view chunk) {
+            response.append(chunk);
+        });
         return response;
     }
 
-    /// @brief Fetches contents from a website or from a file (type of data detected automatically).
+    /// @brief Translates a calendar location to an HTTP(S) URL.
     /// If the URI protocol is webcal(s), it is translated to http(s) accordingly.
     /// @param path URI or file path
-    /// @return response data
-    /// @throws usos_rpc::Exception when the underlying function calls fail
-    std::string fetch_content(const std::string& path) {
+    /// @return URL or nullopt if the location is a file path
+    [[nodiscard]]
+    std::optional<std::string> http_url(const std::string& path) {
         if (path.starts_with("webcal://")) {
             std::string_view real_path(path.begin() + const_string_length("webcal://"), path.end());
             std::string new_path("http://");
             new_path.append(real_path);
-            return http_get(new_path.c_str());
+            return new_path;
         } else if (path.starts_with("webcals://")) {
             std::string_view real_path(path.begin() + const_string_length("webcals://"), path.end());
             std::string new_path("https://");
             new_path.append(real_path);
-            return http_get(new_path.c_str());
+            return new_path;
         } else if (path.starts_with("http://") || path.starts_with("https://")) {
-            return http_get(path.c_str());
-        } else {
-            return read_file(path);
+            return path;
         }
+        return std::nullopt;
+    }
+
+    /// @brief Fetches contents from a website or from a file (type of data detected automatically).
+    /// If the URI protocol is webcal(s), it is translated to http(s) accordingly.
+    /// @param path URI or file path
+    /// @return response data
+    /// @throws usos_rpc::Exception when the underlying function calls fail
+    std::string fetch_content(const std::string& path) {
+        auto url = http_url(path);
+        return url.has_value() ? http_get(url->c_str()) : read_file(path);
     }
 
 }
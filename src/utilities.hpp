@@ -4,8 +4,12 @@
 #pragma once
 
 #include <algorithm>
+#include <cctype>
 #include <cstddef>
+#include <filesystem>
+#include <ranges>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace usos_rpc {
@@ -19,35 +23,28 @@ namespace usos_rpc {
         return N - 1;
     }
 
-    /// @brief Splits a string into a vector of strings by a delimiter.
+    /// @brief Splits a string by a delimiter, without copying or allocating anything.
     /// @param input string to split
     /// @param delimiter where to split
-    /// @return vector of strings
+    /// @return lazy range of views into the input
     [[nodiscard]]
-    std::vector<std::string> split(const std::string& input, const std::string& delimiter) {
-        std::vector<std::string> result;
-        std::size_t start = 0;
-        std::size_t end = input.find(delimiter);
-        while (end != std::string::npos) {
-            result.push_back(input.substr(start, end - start));
-            start = end + delimiter.size();
-            end = input.find(delimiter, start);
-        }
-        result.push_back(input.substr(start, end));
-        return result;
+    auto split(std::string_view input, std::string_view delimiter) {
+        return input | std::views::split(delimiter) | std::views::transform([](auto&& part) {
+                   return std::string_view(part.begin(), part.end());
+               });
     }
 
     /// @brief Removes whitespace from the beginning and the end of a string.
     /// @param input string to process
-    /// @return stripped/trimmed string
+    /// @return stripped/trimmed view into the input
     [[nodiscard]]
-    std::string strip(const std::string& input) {
+    std::string_view strip(std::string_view input) {
         std::size_t start = 0;
         std::size_t end = input.size();
-        while (start < end && std::isspace(input[start])) {
+        while (start < end && std::isspace(static_cast<unsigned char>(input[start]))) {
             start++;
         }
-        while (end > start && std::isspace(input[end - 1])) {
+        while (end > start && std::isspace(static_cast<unsigned char>(input[end - 1]))) {
             end--;
         }
         return input.substr(start, end - start);
@@ -0,0 +1,254 @@
+/// @file
+/// @brief Counts heap allocations of refreshing a calendar from a file (reading, parsing and replacing the cached
+/// calendar) with global operator new replaced by a counting version, and checks them against a budget.
+///
+/// The budget covers the 60-event fixture, with about twice the 145 allocations and 190 KB measured for the first
+/// refresh. Events, strings and the interval index live in the arena of the calendar, so most of the remaining
+/// allocations are copies of added events in the diff and buffers of the snapshot file, far fewer than the few
+/// allocations per string of the old Event class. A refresh of unchanged data stops at the fingerprint
+/// and allocates almost nothing. After a restart, a download of unchanged data is compared with the snapshot
+/// and never parsed, with 15 allocations and 58 KB measured (30 allocations and 110 KB when it was parsed).
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "icalendar/calendar_diff.hpp"
+#include "icalendar/parser.hpp"
+#include "local_server.hpp"
+#include "test.hpp"
+
+#include "fmt/format.h"
+
+namespace {
+
+    /// @brief Number of events in the fixture calendar.
+    constexpr std::size_t FIXTURE_EVENTS = 60;
+    /// @brief Most allocations allowed for the first refresh, which parses the whole calendar.
+    constexpr std::size_t REFRESH_ALLOCATIONS = 300;
+    /// @brief Most bytes allowed to be allocated by the first refresh, about 16 times the size of the file.
+    constexpr std::size_t REFRESH_BYTES = 400 * 1024;
+    /// @brief Most allocations allowed for a refresh of unchanged data.
+    constexpr std::size_t UNCHANGED_ALLOCATIONS = 16;
+    /// @brief Most allocations allowed for a download of unchanged data after a restart.
+    constexpr std::size_t RESTART_ALLOCATIONS = 24;
+    /// @brief Most bytes allowed to be allocated by a download of unchanged data after a restart, enough for
+    /// the buffered body but not for parsing it.
+    constexpr std::size_t RESTART_BYTES = 80 * 1024;
+
+    /// @brief Whether allocations are being counted.
+    std::atomic<bool> counting = false;
+    /// @brief Number of allocations since counting started.
+    std::atomic<std::size_t> allocations = 0;
+    /// @brief Number of bytes allocated since counting started.
+    std::atomic<std::size_t> allocated_bytes = 0;
+
+    /// @brief Allocates memory with malloc(), counting the allocation.
+    /// @param size requested size
+    /// @param extra bytes allocated on top of the requested size, not counted
+    /// @return allocated memory or nullptr
+    void* counted_malloc(std::size_t size, std::size_t extra = 0) noexcept {
+        if (counting) {
+            allocations++;
+            allocated_bytes += size;
+        }
+        return std::malloc(size + extra == 0 ? 1 : size + extra);
+    }
+
+    /// @brief Allocates memory aligned more than malloc() guarantees. The pointer returned by malloc() is stored
+    /// right before the aligned block, for aligned_free().
+    /// @param size requested size
+    /// @param alignment requested alignment
+    /// @return allocated memory or nullptr
+    void* aligned_malloc(std::size_t size, std::align_val_t alignment) noexcept {
+        auto align = static_cast<std::size_t>(alignment);
+        auto* memory = static_cast<char*>(counted_malloc(size, align + sizeof(void*)));
+        if (memory == nullptr) {
+            return nullptr;
+        }
+        auto address = reinterpret_cast<std::uintptr_t>(memory + sizeof(void*));
+        auto* aligned = reinterpret_cast<void**>((address + align - 1) & ~(align - 1));
+        aligned[-1] = memory;
+        return aligned;
+    }
+
+    /// @brief Frees memory allocated with aligned_malloc().
+    /// @param pointer allocated memory or nullptr
+    void aligned_free(void* pointer) noexcept {
+        if (pointer != nullptr) {
+            std::free(static_cast<void**>(pointer)[-1]);
+        }
+    }
+
+    /// @brief Throws std::bad_alloc for a failed allocation, like the default operator new.
+    /// @param memory allocated memory or nullptr
+    /// @return allocated memory
+    void* checked(void* memory) {
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+}
+
+void* operator new(std::size_t size) {
+    return checked(counted_malloc(size));
+}
+
+void* operator new[](std::size_t size) {
+    return checked(counted_malloc(size));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return checked(aligned_malloc(size, alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return checked(aligned_malloc(size, alignment));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return aligned_malloc(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return aligned_malloc(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    aligned_free(pointer);
+}
+
+int main() {
+    using namespace usos_rpc;
+    const auto path = tests::fixture("calendar.ics").string();
+    // Events are parsed on the calling thread, as starting threads allocates too.
+    auto config = tests::make_config(fmt::format("calendar = '{}'\nparser_threads = 1\n", path));
+
+    // The time zone database and the config directory are loaded once per process, outside of the budget.
+    const auto reference = icalendar::parse(read_file(path));
+    (void) get_config_directory();
+
+    counting = true;
+    auto diff = config.refresh_calendar(0);
+    counting = false;
+    const std::size_t refresh_allocations = allocations.exchange(0);
+    const std::size_t refresh_bytes = allocated_bytes.exchange(0);
+    tests::check(reference.records().size() == FIXTURE_EVENTS, "fixture has {} events", reference.records().size());
+    tests::check(
+        diff.has_value() && diff->count(icalendar::ChangeType::ADDED) == FIXTURE_EVENTS,
+        "first refresh did not add all events"
+    );
+    tests::check(
+        refresh_allocations <= REFRESH_ALLOCATIONS,
+        "first refresh made {} allocations, budget is {}",
+        refresh_allocations,
+        REFRESH_ALLOCATIONS
+    );
+    tests::check(
+        refresh_bytes <= REFRESH_BYTES,
+        "first refresh allocated {} bytes, budget is {}",
+        refresh_bytes,
+        REFRESH_BYTES
+    );
+
+    counting = true;
+    auto unchanged = config.refresh_calendar(0);
+    counting = false;
+    const std::size_t unchanged_allocations = allocations.exchange(0);
+    tests::check(!unchanged.has_value(), "refresh of unchanged data reported changes");
+    tests::check(
+        unchanged_allocations <= UNCHANGED_ALLOCATIONS,
+        "refresh of unchanged data made {} allocations, budget is {}",
+        unchanged_allocations,
+        UNCHANGED_ALLOCATIONS
+    );
+
+    // After a restart the calendar comes from the snapshot, and a download of unchanged data is only fingerprinted.
+    tests::LocalServer server(read_file(path));
+    const auto settings = fmt::format("calendar = '{}'\nparser_threads = 1\n", server.url());
+    {
+        auto downloading = tests::make_config(settings);
+        (void) downloading.refresh_calendar(0);
+    }
+    auto restarted = tests::make_config(settings);
+    tests::check(restarted.load_snapshot(), "snapshot of the download has not been loaded");
+    counting = true;
+    auto restarted_diff = restarted.refresh_calendar(0);
+    counting = false;
+    const std::size_t restart_allocations = allocations.exchange(0);
+    const std::size_t restart_bytes = allocated_bytes.exchange(0);
+    tests::check(!restarted_diff.has_value(), "download of unchanged data after a restart reported changes");
+    tests::check(
+        restart_allocations <= RESTART_ALLOCATIONS,
+        "download of unchanged data after a restart made {} allocations, budget is {}",
+        restart_allocations,
+        RESTART_ALLOCATIONS
+    );
+    tests::check(
+        restart_bytes <= RESTART_BYTES,
+        "download of unchanged data after a restart allocated {} bytes, budget is {}",
+        restart_bytes,
+        RESTART_BYTES
+    );
+
+    fmt::print("First refresh: {} allocations, {} bytes\n", refresh_allocations, refresh_bytes);
+    fmt::print("Unchanged refresh: {} allocations\n", unchanged_allocations);
+    fmt::print("Download after a restart: {} allocations, {} bytes\n", restart_allocations, restart_bytes);
+    return tests::failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/// @file
+/// @brief Checks that usos_rpc::icalendar::CalendarSet merges events of several sources in order of time of start,
+/// with interleaved events and duplicates of unique identifiers from earlier sources skipped.
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "icalendar/calendar_set.hpp"
+#include "icalendar/parser.hpp"
+#include "test.hpp"
+
+#include "date/date.h"
+#include "fmt/format.h"
+#include "fmt/ranges.h"
+
+namespace {
+
+    /// @brief Event of a test calendar, on 2024-10-07.
+    struct TestEvent {
+        /// @brief Unique identifier.
+        std::string_view uid;
+        /// @brief Subject, unique among all test events, so that duplicates can be told apart.
+        std::string_view subject;
+        /// @brief Local time of start, as HHMMSS.
+        std::string_view start;
+        /// @brief Local time of end, as HHMMSS.
+        std::string_view end;
+    };
+
+    /// @brief Creates a calendar with the given events.
+    /// @param events events of the calendar, in any order
+    /// @return parsed calendar
+    usos_rpc::icalendar::Calendar make_calendar(const std::vector<TestEvent>& events) {
+        std::string text =
+            "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//usos-rpc//tests//EN\r\nX-WR-CALNAME:Test\r\n"
+            "X-WR-TIMEZONE:Europe/Warsaw\r\n";
+        for (const auto& event : events) {
+            text += fmt::format(
+                "BEGIN:VEVENT\r\nDTSTART:20241007T{}\r\nDTEND:20241007T{}\r\nSUMMARY:{}\r\nUID:{}\r\n"
+                "DESCRIPTION:sala: 0.03\r\nEND:VEVENT\r\n",
+                event.start,
+                event.end,
+                event.subject,
+                event.uid
+            );
+        }
+        text += "END:VCALENDAR\r\n";
+        return usos_rpc::icalendar::parse(text);
+    }
+
+    /// @brief Converts a local time on 2024-10-07 in Warsaw (UTC+2 in summer) to a point in time.
+    /// @param hour hour of the local time
+    /// @param minute minute of the local time
+    /// @return point in time
+    std::chrono::system_clock::time_point at(int hour, int minute) {
+        using namespace std::chrono;
+        return sys_days(date::year(2024) / 10 / 7) + hours(hour - 2) + minutes(minute);
+    }
+
+    /// @brief Returns subjects of events.
+    /// @param events events in any range
+    /// @return subjects in the same order
+    std::vector<std::string_view> subjects(auto&& events) {
+        std::vector<std::string_view> result;
+        for (const auto& event : events) {
+            result.push_back(event.subject());
+        }
+        return result;
+    }
+
+}
+
+int main() {
+    using namespace usos_rpc;
+    icalendar::CalendarSet set(3);
+    set.replace(0, make_calendar({
+        { .uid = "a", .subject = "A0", .start = "100000", .end = "110000" },
+        { .uid = "c", .subject = "C0", .start = "140000", .end = "150000" },
+    }));
+    // The second occurrence of 'a' belongs to the first source, so it is skipped.
+    set.replace(1, make_calendar({
+        { .uid = "b", .subject = "B1", .start = "090000", .end = "103000" },
+        { .uid = "a", .subject = "A1", .start = "120000", .end = "130000" },
+        { .uid = "d", .subject = "D1", .start = "140000", .end = "143000" },
+    }));
+    set.replace(2, make_calendar({
+        { .uid = "b", .subject = "B2", .start = "080000", .end = "083000" },
+        { .uid = "e", .subject = "E2", .start = "110000", .end = "160000" },
+    }));
+
+    using Subjects = std::vector<std::string_view>;
+    // Events starting at the same time are ordered by source.
+    auto all = subjects(set.events());
+    tests::check(all == Subjects { "B1", "A0", "E2", "C0", "D1" }, "merged events are {}", all);
+
+    auto between = subjects(set.events_between(at(10, 45), at(13, 0)));
+    tests::check(between == Subjects { "A0", "E2" }, "events between 10:45 and 13:00 are {}", between);
+    auto current = subjects(set.events_at(at(14, 15)));
+    tests::check(current == Subjects { "E2", "C0", "D1" }, "events at 14:15 are {}", current);
+    auto none = set.events_between(at(6, 0), at(7, 0));
+    tests::check(none.empty(), "events before the first one are {}", subjects(none));
+
+    auto next_subject = [&set](std::chrono::system_clock::time_point now) {
+        auto event = set.next_event(now);
+        return event.has_value() ? event->subject() : std::string_view("none");
+    };
+    // Events ending right now have not ended yet.
+    tests::check(next_subject(at(7, 0)) == "B1", "next event at 7:00 is {}", next_subject(at(7, 0)));
+    tests::check(next_subject(at(11, 0)) == "A0", "next event at 11:00 is {}", next_subject(at(11, 0)));
+    // The long event of the last source is still running when all shorter ones have ended.
+    tests::check(next_subject(at(11, 30)) == "E2", "next event at 11:30 is {}", next_subject(at(11, 30)));
+    tests::check(next_subject(at(15, 30)) == "E2", "next event at 15:30 is {}", next_subject(at(15, 30)));
+    tests::check(next_subject(at(16, 30)) == "none", "next event at 16:30 is {}", next_subject(at(16, 30)));
+
+    // Replacing the first source makes the events of 'a' from the second one visible.
+    set.replace(0, make_calendar({
+        { .uid = "c", .subject = "C0", .start = "140000", .end = "150000" },
+    }));
+    all = subjects(set.events());
+    tests::check(all == Subjects { "B1", "E2", "A1", "C0", "D1" }, "merged events after replacing are {}", all);
+    return tests::failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/// @file
+/// @brief HTTP server on a local port, serving a single calendar to the tests.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "test.hpp"
+
+#include "fmt/format.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+namespace usos_rpc::tests {
+
+    // clang-format off
+    #ifdef _WIN32
+        /// @brief Socket handle.
+        using Socket = SOCKET;
+        /// @brief Invalid socket handle.
+        constexpr Socket NO_SOCKET = INVALID_SOCKET;
+    #else
+        /// @brief Socket handle.
+        using Socket = int;
+        /// @brief Invalid socket handle.
+        constexpr Socket NO_SOCKET = -1;
+    #endif
+    // clang-format on
+
+    /// @brief Closes a socket.
+    /// @param socket socket to close
+    void close_socket(Socket socket) {  // clang-format off
+        #ifdef _WIN32
+            closesocket(socket);
+        #else
+            close(socket);
+        #endif
+    }  // clang-format on
+
+    /// @brief HTTP server on a local port, which answers every request with the same calendar and closes
+    /// the connection. A stalled server sends only the beginning of the response instead and then stops sending
+    /// anything, like an overloaded server. Its connections stay open until it is destroyed.
+    class LocalServer {
+        /// @brief Response sent to every request.
+        std::string _response;
+        /// @brief Whether connections are kept open after sending the response.
+        bool _stalled;
+        /// @brief Listening socket.
+        Socket _listener = NO_SOCKET;
+        /// @brief Port chosen by the system.
+        std::uint16_t _port = 0;
+        /// @brief Connections kept open by a stalled server.
+        std::vector<Socket> _clients;
+        /// @brief Whether the server thread should stop accepting connections.
+        std::atomic<bool> _stopping = false;
+        /// @brief Thread accepting connections.
+        std::thread _thread;
+
+        /// @brief Reads a request up to the end of its headers. Requests of the tests have no body.
+        /// @param client accepted connection
+        void read_request(Socket client) {
+            // Only the end of the headers is looked for, so the buffer keeps just enough of the previous chunk.
+            constexpr std::string_view END = "\r\n\r\n";
+            char buffer[1024];
+            std::size_t kept = 0;
+            while (true) {
+                auto received = recv(client, buffer + kept, static_cast<int>(sizeof(buffer) - kept), 0);
+                if (received <= 0) {
+                    return;
+                }
+                std::string_view data(buffer, kept + static_cast<std::size_t>(received));
+                if (data.find(END) != std::string_view::npos) {
+                    return;
+                }
+                kept = std::min(data.size(), END.size() - 1);
+                std::copy(data.end() - kept, data.end(), buffer);
+            }
+        }
+
+        /// @brief Answers connections until the server is destroyed, checking for that every 50 ms.
+        void serve() {
+            while (!_stopping) {
+                fd_set readable;
+                FD_ZERO(&readable);
+                FD_SET(_listener, &readable);
+                timeval timeout { .tv_sec = 0, .tv_usec = 50'000 };
+                if (select(static_cast<int>(_listener) + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+                    continue;
+                }
+                auto client = accept(_listener, nullptr, nullptr);
+                if (client == NO_SOCKET) {
+                    continue;
+                }
+                read_request(client);
+                send(client, _response.data(), static_cast<int>(_response.size()), 0);
+                if (_stalled) {
+                    _clients.push_back(client);
+                } else {
+                    close_socket(client);
+                }
+            }
+        }
+
+    public:
+        /// @brief Starts the server on a free port of the loopback interface.
+        /// @param calendar calendar sent in every response
+        /// @param stalled whether to announce a much longer body than the calendar, so that clients keep waiting
+        /// for the rest
+        explicit LocalServer(std::string_view calendar, bool stalled = false):
+        _response(fmt::format(
+            "HTTP/1.1 200 OK\r\nContent-Type: text/calendar\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+            stalled ? 1'000'000 : calendar.size(),
+            calendar
+        )),
+        _stalled(stalled) {  // clang-format off
+            #ifdef _WIN32
+                WSADATA data;
+                WSAStartup(MAKEWORD(2, 2), &data);
+            #endif
+            // clang-format on
+            _listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in address {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+            socklen_t length = sizeof(address);
+            if (_listener == NO_SOCKET
+                || bind(_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(_listener, 4) != 0
+                || getsockname(_listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+                check(false, "could not start the local server");
+                return;
+            }
+            _port = ntohs(address.sin_port);
+            _thread = std::thread(&LocalServer::serve, this);
+        }
+
+        LocalServer(const LocalServer&) = delete;
+        LocalServer& operator=(const LocalServer&) = delete;
+
+        ~LocalServer() {
+            _stopping = true;
+            if (_thread.joinable()) {
+                _thread.join();
+            }
+            for (auto client : _clients) {
+                close_socket(client);
+            }
+            if (_listener != NO_SOCKET) {
+                close_socket(_listener);
+            }
+        }
+
+        /// @brief Returns the URL of the calendar on the server.
+        /// @return URL
+        [[nodiscard]]
+        std::string url() const {
+            return fmt::format("http://127.0.0.1:{}/calendar.ics", _port);
+        }
+    };
+
+}
@@ -0,0 +1,52 @@
+/// @file
+/// @brief Helpers shared by the tests: fixtures, configs and checks.
+
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+#include <utility>
+
+#include "config.hpp"
+#include "files.hpp"  // Also defines get_config_directory() for logging.cpp.
+
+#include "fmt/format.h"
+#include "toml++/toml.hpp"
+
+namespace usos_rpc::tests {
+
+    /// @brief Number of failed checks, returned from main() by every test.
+    int failures = 0;
+
+    /// @brief Reports a failed check without stopping the test, so that all failures are listed at once.
+    /// @param condition checked condition
+    /// @param message description of the failure, as a format string
+    /// @param args format arguments
+    template <typename... Args>
+    void check(bool condition, fmt::format_string<Args...> message, Args&&... args) {
+        if (!condition) {
+            failures++;
+            fmt::print(stderr, "FAILED: {}\n", fmt::format(message, std::forward<Args>(args)...));
+        }
+    }
+
+    /// @brief Returns the path of a file in the tests/fixtures directory.
+    /// @param name file name
+    /// @return file path
+    [[nodiscard]]
+    std::filesystem::path fixture(std::string_view name) {
+        return std::filesystem::path(USOS_RPC_TEST_FIXTURES) / name;
+    }
+
+    /// @brief Creates a config from TOML settings, with a placeholder Discord application identifier.
+    /// Tests are run with USOS_RPC_DIR pointing to their own directory, so snapshots never replace real ones.
+    /// @param settings contents of config.toml, at least the calendar location
+    /// @return config
+    /// @throws usos_rpc::Exception when the settings are invalid
+    [[nodiscard]]
+    Config make_config(std::string_view settings) {
+        auto table = toml::parse(fmt::format("discord_app_id = 123456789\n{}", settings));
+        return Config(table);
+    }
+
+}
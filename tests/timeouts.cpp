@@ -0,0 +1,130 @@
+/// @file
+/// @brief Checks that downloads from a server which stops sending data in the middle of a response
+/// end with a timeout, and that usos_rpc::cancel_requests() called from another thread stops them within milliseconds.
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fetcher.hpp"
+#include "local_server.hpp"
+#include "requests.hpp"
+#include "test.hpp"
+
+#include "fmt/format.h"
+
+namespace {
+
+    /// @brief Fetches the calendar of the first source, expecting an exception.
+    /// @param config config with the calendar source
+    /// @return message of the exception or an empty string if nothing has been thrown
+    std::string fetch_error(usos_rpc::Config& config) {
+        try {
+            (void) config.fetch_calendar(0, nullptr);
+        } catch (const usos_rpc::Exception& e) {
+            return e.what();
+        }
+        return std::string();
+    }
+
+    /// @brief Checks that the low speed limit aborts a download which has stalled.
+    void test_timeout() {
+        using namespace usos_rpc;
+        tests::LocalServer server("BEGIN:VCALENDAR\r\n", true);
+        auto config = tests::make_config(fmt::format(
+            "calendar = '{}'\nconnect_timeout = 1\nrequest_timeout = 5\nlow_speed_limit = 100\nlow_speed_time = 1\n",
+            server.url()
+        ));
+
+        auto start = std::chrono::steady_clock::now();
+        auto error = fetch_error(config);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        tests::check(error.find("Timeout") != std::string::npos, "stalled download ended with '{}'", error);
+        tests::check(
+            elapsed < std::chrono::seconds(4),
+            "stalled download took {} ms",
+            std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+        );
+        tests::check(config.http_cache(0).size == 0, "stalled download has been cached");
+    }
+
+    /// @brief Returns the message of an exception.
+    /// @param error exception thrown by a fetch
+    /// @return message of the exception or an empty string if nothing has been thrown
+    std::string error_message(std::exception_ptr error) {
+        try {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        } catch (const usos_rpc::Exception& e) {
+            return e.what();
+        }
+        return std::string();
+    }
+
+    /// @brief Checks that cancelling requests from another thread aborts stalled downloads within milliseconds,
+    /// both a blocking one and one on the I/O thread of usos_rpc::CalendarFetcher.
+    /// Cancellation lasts until the end of the program, so this has to be the last test.
+    void test_cancellation() {
+        using namespace usos_rpc;
+        constexpr std::chrono::milliseconds MAX_DELAY(200);
+        tests::LocalServer server("BEGIN:VCALENDAR\r\n", true);
+        // The timeouts are long enough not to end the downloads themselves. Each download has its own config,
+        // as a single config cannot fetch the same source on two threads at once.
+        auto settings = fmt::format("calendar = '{}'\nrequest_timeout = 60\nlow_speed_limit = 0\n", server.url());
+        auto config = tests::make_config(settings);
+        auto background_config = tests::make_config(settings);
+        CalendarFetcher fetcher(background_config);
+        fetcher.refresh();
+
+        std::atomic<std::chrono::steady_clock::time_point> cancelled;
+        std::thread canceller([&cancelled] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            cancelled = std::chrono::steady_clock::now();
+            cancel_requests();
+        });
+        auto error = fetch_error(config);
+        auto stopped = std::chrono::steady_clock::now();
+        canceller.join();
+
+        // Results of the I/O thread are taken like the service loop does, only much more often.
+        std::vector<CalendarFetcher::Result> results;
+        while (results.empty() && std::chrono::steady_clock::now() - cancelled.load() < std::chrono::seconds(5)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            results = fetcher.take_results();
+        }
+        auto background_stopped = std::chrono::steady_clock::now();
+
+        auto milliseconds = [&cancelled](std::chrono::steady_clock::time_point time) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(time - cancelled.load()).count();
+        };
+        tests::check(error.find("cancelled") != std::string::npos, "cancelled download ended with '{}'", error);
+        tests::check(
+            stopped - cancelled.load() < MAX_DELAY,
+            "cancelled download took {} ms to stop",
+            milliseconds(stopped)
+        );
+        auto background_error = results.empty() ? std::string() : error_message(results.front().error);
+        tests::check(
+            background_error.find("cancelled") != std::string::npos,
+            "cancelled background download ended with '{}'",
+            background_error
+        );
+        tests::check(
+            background_stopped - cancelled.load() < MAX_DELAY,
+            "cancelled background download took {} ms to stop",
+            milliseconds(background_stopped)
+        );
+    }
+
+}
+
+int main() {
+    test_timeout();
+    test_cancellation();
+    return usos_rpc::tests::failures == 0 ? 0 : 1;
+}